@@ -0,0 +1,545 @@
+/* --affected-by: Compares the symbols of a subject with those of a previous build,
+	and only runs the test objects that import a symbol whose bytes changed.
+	On x86-64, rel32 displacements that reach the same symbol in both builds are masked, so functions that merely moved compare equal.
+	Elsewhere, every function after a resized one differs in its relative addresses and is selected, which over-selects but never misses.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The EI_CLASS of objects that can be loaded into this process */
+#define NATIVE_CLASS (__ELF_NATIVE_CLASS == 64 ? ELFCLASS64 : ELFCLASS32)
+
+#if __ELF_NATIVE_CLASS == 64
+#define R_SYM ELF64_R_SYM
+#else
+#define R_SYM ELF32_R_SYM
+#endif
+
+/** A read-only mapping of a shared object file */
+struct Image
+{
+	const char *path;
+	const char *file;
+	size_t size;
+	const ElfW(Shdr) *sections;
+	size_t sectionCount;
+	/** The section name string table */
+	const char *sectionNames;
+	/** Whether the code is x86-64, whose rel32 displacements are masked when comparing */
+	bool rel32;
+};
+
+/** A defined function or object of an image */
+struct Symbol
+{
+	const char *name;
+	/** The position in the symbol table, which orders symbols of the same name */
+	size_t index;
+	/** The contents of the symbol in the file, or NULL if it takes up no space there */
+	const void *bytes;
+	size_t size;
+	uintptr_t address;
+	/** Whether other objects can link against the symbol */
+	bool exported;
+	bool function;
+};
+
+/** The symbols of one build, see collectSymbols() */
+struct Symbols
+{
+	/** Sorted by _cmp_symbol() */
+	struct Symbol *byName;
+	/** The symbols taking up space, sorted by _cmp_address(), which resolves displacements to symbols */
+	struct Symbol *byAddress;
+	size_t count, sized;
+	/** Whether the full symbol table was used */
+	bool full;
+};
+
+/** Maps a shared object file and checks its headers
+	@returns false and prints an error message on failure
+ */
+static bool mapImage(const char *path, struct Image *img)
+{
+	*img = (struct Image){ .path = path };
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if(fd < 0 || fstat(fd, &st))
+	{
+		fprintf(stderr, RED_BOLD("Can't compare") " '%s': %s\n", path, strerror(errno));
+
+		if(fd >= 0)
+			close(fd);
+
+		return false;
+	}
+
+	void *map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+
+	if(map == MAP_FAILED)
+	{
+		fprintf(stderr, RED_BOLD("Can't compare") " '%s': mmap(): %s\n", path, st.st_size ? strerror(errno) : "Empty file");
+		return false;
+	}
+
+	const ElfW(Ehdr) *eh = map;
+	img->file = map;
+	img->size = st.st_size;
+
+	if(img->size < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != NATIVE_CLASS
+		|| eh->e_type != ET_DYN || eh->e_shentsize != sizeof(ElfW(Shdr)) || eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > img->size
+		|| eh->e_shstrndx >= eh->e_shnum)
+	{
+		fprintf(stderr, RED_BOLD("Can't compare") " '%s': Not a shared object of this architecture\n", path);
+		munmap(map, img->size);
+		return false;
+	}
+
+	img->sections = (const void*)(img->file + eh->e_shoff);
+	img->sectionCount = eh->e_shnum;
+	img->sectionNames = img->file + img->sections[eh->e_shstrndx].sh_offset;
+	img->rel32 = eh->e_machine == EM_X86_64;
+	return true;
+}
+
+/** Whether a section holds addresses filled in by the dynamic linker, whose bytes change whenever the layout does */
+static bool isLinkerData(const struct Image *img, const ElfW(Shdr) *sh)
+{
+	const char *name = img->sectionNames + sh->sh_name;
+
+	return sh->sh_type == SHT_DYNAMIC || sh->sh_type == SHT_INIT_ARRAY || sh->sh_type == SHT_FINI_ARRAY || sh->sh_type == SHT_PREINIT_ARRAY
+		|| strcmp(name, ".got") == 0 || strcmp(name, ".got.plt") == 0;
+}
+
+/** Orders symbols by name, and symbols of the same name by their position */
+static int _cmp_symbol(const void *_l, const void *_r)
+{
+	const struct Symbol *l = _l, *r = _r;
+	int c = strcmp(l->name, r->name);
+
+	return c ? c : (l->index > r->index) - (l->index < r->index);
+}
+
+/** Orders symbols by address, and aliases by _cmp_symbol(), so that both builds resolve an address to the same alias */
+static int _cmp_address(const void *_l, const void *_r)
+{
+	const struct Symbol *l = _l, *r = _r;
+
+	return l->address != r->address ? (l->address > r->address) - (l->address < r->address) : _cmp_symbol(l, r);
+}
+
+static int _cmp_name(const void *_l, const void *_r)
+{
+	return strcmp(*(const char *const*)_l, *(const char *const*)_r);
+}
+
+/** Collects every defined function and object of an image.
+	Uses the full symbol table if there is one, so that changes to internal functions are noticed, and the dynamic symbol table otherwise.
+	@returns false if memory ran out
+ */
+static bool collectSymbols(const struct Image *img, struct Symbols *out)
+{
+	const ElfW(Shdr) *table = NULL;
+
+	for(size_t i = 0; i < img->sectionCount; ++i)
+	{
+		const ElfW(Shdr) *sh = &img->sections[i];
+
+		if((sh->sh_type == SHT_SYMTAB || (sh->sh_type == SHT_DYNSYM && table == NULL))
+			&& sh->sh_link < img->sectionCount && sh->sh_offset + sh->sh_size <= img->size)
+			table = sh;
+	}
+
+	*out = (struct Symbols){ .full = table && table->sh_type == SHT_SYMTAB };
+
+	if(table == NULL)
+		return true;
+
+	const ElfW(Sym) *syms = (const void*)(img->file + table->sh_offset);
+	const char *strings = img->file + img->sections[table->sh_link].sh_offset;
+	size_t total = table->sh_size / sizeof(ElfW(Sym));
+
+	out->byName = malloc(total * sizeof(struct Symbol));
+	out->byAddress = malloc(total * sizeof(struct Symbol));
+
+	if(out->byName == NULL || out->byAddress == NULL)
+	{
+		free(out->byName);
+		free(out->byAddress);
+		return false;
+	}
+
+	for(size_t i = 1; i < total; ++i)
+	{
+		const ElfW(Sym) *s = &syms[i];
+		// these fields are encoded the same way in both ELF classes
+		unsigned type = ELF64_ST_TYPE(s->st_info), bind = ELF64_ST_BIND(s->st_info), vis = ELF64_ST_VISIBILITY(s->st_other);
+
+		if(s->st_name == 0 || s->st_shndx == SHN_UNDEF || s->st_shndx >= img->sectionCount
+			|| (type != STT_FUNC && type != STT_GNU_IFUNC && type != STT_OBJECT))
+			continue;
+
+		const ElfW(Shdr) *sh = &img->sections[s->st_shndx];
+		const void *bytes = NULL;
+
+		if(isLinkerData(img, sh))
+			continue;
+
+		if(sh->sh_type != SHT_NOBITS)
+		{
+			size_t offset = sh->sh_offset + (s->st_value - sh->sh_addr);
+
+			// symbols pointing outside of the file are compared by size only
+			if(s->st_value >= sh->sh_addr && offset + s->st_size <= img->size)
+				bytes = img->file + offset;
+		}
+
+		struct Symbol *sym = &out->byName[out->count++];
+
+		*sym = (struct Symbol){
+			.name = strings + s->st_name,
+			.index = i,
+			.bytes = bytes,
+			.size = s->st_size,
+			.address = s->st_value,
+			.exported = bind != STB_LOCAL && (vis == STV_DEFAULT || vis == STV_PROTECTED),
+			.function = type != STT_OBJECT
+		};
+
+		if(sym->size)
+			out->byAddress[out->sized++] = *sym;
+	}
+
+	qsort(out->byName, out->count, sizeof(struct Symbol), _cmp_symbol);
+	qsort(out->byAddress, out->sized, sizeof(struct Symbol), _cmp_address);
+	return true;
+}
+
+/** Collects the defined symbols that an image's own relocations refer to.
+	The subject reaches these through its PLT or GOT, so a change to them affects its other functions without changing their bytes.
+	@returns A malloc()ed list of names sorted by _cmp_name(), or NULL if memory ran out
+ */
+static const char **collectSelfUses(const struct Image *img, size_t *count)
+{
+	const char **names = NULL;
+	size_t capacity = 0;
+
+	*count = 0;
+
+	for(size_t i = 0; i < img->sectionCount; ++i)
+	{
+		const ElfW(Shdr) *sh = &img->sections[i];
+
+		if((sh->sh_type != SHT_RELA && sh->sh_type != SHT_REL) || sh->sh_link >= img->sectionCount || sh->sh_entsize == 0
+			|| sh->sh_offset + sh->sh_size > img->size)
+			continue;
+
+		const ElfW(Shdr) *table = &img->sections[sh->sh_link];
+
+		if(table->sh_link >= img->sectionCount || table->sh_offset + table->sh_size > img->size)
+			continue;
+
+		const ElfW(Sym) *syms = (const void*)(img->file + table->sh_offset);
+		const char *strings = img->file + img->sections[table->sh_link].sh_offset;
+		size_t symCount = table->sh_size / sizeof(ElfW(Sym));
+
+		// r_info sits at the same place in Rel and Rela entries
+		for(size_t off = 0; off + sh->sh_entsize <= sh->sh_size; off += sh->sh_entsize)
+		{
+			const ElfW(Rel) *r = (const void*)(img->file + sh->sh_offset + off);
+			size_t index = R_SYM(r->r_info);
+
+			if(index == 0 || index >= symCount || syms[index].st_shndx == SHN_UNDEF || syms[index].st_name == 0)
+				continue;
+
+			if(*count == capacity)
+			{
+				const char **grown = realloc(names, (capacity = capacity ? 2 * capacity : 64) * sizeof(char*));
+
+				if(grown == NULL)
+				{
+					free(names);
+					return NULL;
+				}
+
+				names = grown;
+			}
+
+			names[(*count)++] = strings + syms[index].st_name;
+		}
+	}
+
+	if(names == NULL)
+		names = malloc(sizeof(char*));
+	else
+		qsort(names, *count, sizeof(char*), _cmp_name);
+
+	return names;
+}
+
+/** Resolves an address to the symbol containing it, or to its section if there is none
+	@returns false if the address lies outside of the image
+ */
+static bool resolve(const struct Image *img, const struct Symbols *symbols, uintptr_t address, const char **name, uintptr_t *offset)
+{
+	size_t lo = 0, hi = symbols->sized;
+
+	// the first symbol after the address
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(symbols->byAddress[mid].address <= address)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if(lo > 0)
+	{
+		const struct Symbol *s = &symbols->byAddress[lo - 1];
+
+		// the first of the aliases
+		while(s > symbols->byAddress && s[-1].address == s->address)
+			--s;
+
+		if(address - s->address < s->size)
+		{
+			*name = s->name;
+			*offset = address - s->address;
+			return true;
+		}
+	}
+
+	for(size_t i = 0; i < img->sectionCount; ++i)
+	{
+		const ElfW(Shdr) *sh = &img->sections[i];
+
+		if((sh->sh_flags & SHF_ALLOC) && address - sh->sh_addr < sh->sh_size)
+		{
+			*name = img->sectionNames + sh->sh_name;
+			*offset = address - sh->sh_addr;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/** @returns Whether the 4 bytes at `at` in both versions of a function are rel32 displacements reaching the same place.
+	This assumes that the displacement ends its instruction, as it does for calls, jumps and most RIP-relative operands,
+	and otherwise reports a difference.
+ */
+static bool sameTarget(const struct Image *oldImg, const struct Symbols *oldSyms, const struct Symbol *old,
+	const struct Image *newImg, const struct Symbols *newSyms, const struct Symbol *new, size_t at)
+{
+	int32_t oDisp, nDisp;
+	const char *oName, *nName;
+	uintptr_t oOffset, nOffset;
+
+	memcpy(&oDisp, (const char*)old->bytes + at, sizeof(oDisp));
+	memcpy(&nDisp, (const char*)new->bytes + at, sizeof(nDisp));
+
+	return resolve(oldImg, oldSyms, old->address + at + sizeof(oDisp) + oDisp, &oName, &oOffset)
+		&& resolve(newImg, newSyms, new->address + at + sizeof(nDisp) + nDisp, &nName, &nOffset)
+		&& oOffset == nOffset && strcmp(oName, nName) == 0;
+}
+
+/** @returns Whether two versions of a symbol differ */
+static bool symbolChanged(const struct Image *oldImg, const struct Symbols *oldSyms, const struct Symbol *old,
+	const struct Image *newImg, const struct Symbols *newSyms, const struct Symbol *new)
+{
+	if(old->size != new->size || !old->bytes != !new->bytes)
+		return true;
+	if(old->bytes == NULL || memcmp(old->bytes, new->bytes, new->size) == 0)
+		return false;
+	if(! (oldImg->rel32 && newImg->rel32 && old->function && new->function))
+		return true;
+
+	const unsigned char *o = old->bytes, *n = new->bytes;
+	size_t masked = 0;
+
+	// each difference has to lie in a displacement that starts at most 3 bytes earlier and doesn't overlap the previous one
+	for(size_t i = 0; i < new->size; ++i)
+	{
+		if(o[i] == n[i])
+			continue;
+
+		size_t at = i >= 3 && i - 3 > masked ? i - 3 : masked;
+
+		while(at <= i && ! (at + 4 <= new->size && sameTarget(oldImg, oldSyms, old, newImg, newSyms, new, at)))
+			++at;
+
+		if(at > i)
+			return true;
+
+		masked = at + 4;
+		i = masked - 1;
+	}
+
+	return false;
+}
+
+/** Compares the symbols of two builds
+	@param changed Receives a malloc()ed list of the names of changed exported symbols, pointing into `new`
+	@param internal Receives the name of a changed symbol that the subject uses itself, which may affect any export, or NULL
+	@returns The length of `changed`, or (size_t)-1 if memory ran out
+ */
+static size_t diffImages(const struct Image *old, const struct Image *new, const char ***changed, const char **internal)
+{
+	struct Symbols o, n;
+	size_t useCount, count = 0;
+	bool oOk = collectSymbols(old, &o), nOk = collectSymbols(new, &n);
+	const char **uses = collectSelfUses(new, &useCount);
+
+	*internal = NULL;
+	*changed = nOk ? malloc((n.count + 1) * sizeof(char*)) : NULL;
+
+	if(! oOk || uses == NULL || *changed == NULL)
+	{
+		free(*changed);
+		count = (size_t)-1;
+		goto out;
+	}
+
+	if(! (o.full && n.full))
+	{
+		fprintf(stderr, YELLOW("'%s' has no symbol table, changes to its internal functions will go unnoticed\n"),
+			o.full ? new->path : old->path);
+	}
+
+	// both lists are sorted, so symbols of the same name pair up in order of their position
+	size_t i = 0, j = 0;
+
+	while(i < o.count || j < n.count)
+	{
+		int c = i == o.count ? 1 : j == n.count ? -1 : strcmp(o.byName[i].name, n.byName[j].name);
+
+		// removed symbols can't be imported anymore, but whatever used them changed
+		if(c < 0 && !o.byName[i].exported && o.full && n.full)
+			*internal = o.byName[i].name;
+		else if(c > 0 || (c == 0 && symbolChanged(old, &o, &o.byName[i], new, &n, &n.byName[j])))
+		{
+			const char *name = n.byName[j].name;
+
+			// an export called through the subject's own PLT changes its callers' behaviour, but not their bytes
+			if(n.byName[j].exported && bsearch(&name, uses, useCount, sizeof(char*), _cmp_name))
+				*internal = name;
+			else if(n.byName[j].exported)
+				(*changed)[count++] = name;
+			else if(o.full && n.full)
+				*internal = name;
+		}
+
+		i += c <= 0;
+		j += c >= 0;
+	}
+
+out:
+	// the names point into the mapped file, not the lists
+	free(o.byName);
+	free(o.byAddress);
+	free(n.byName);
+	free(n.byAddress);
+	free(uses);
+	return count;
+}
+
+/** @returns Whether a test object imports any of the given names */
+static bool importsAny(const struct DL *dl, size_t count, const char *const names[static count])
+{
+	for(size_t i = 1; i < dl->symbolCount; ++i)
+	{
+		const ElfW(Sym) *s = &dl->symbols[i];
+		const char *name = dl->strings + s->st_name;
+
+		if(s->st_shndx == SHN_UNDEF && *name && bsearch(&name, names, count, sizeof(char*), _cmp_name))
+			return true;
+	}
+
+	return false;
+}
+
+/** @returns The base name of a path */
+static const char *baseName(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+bool affectedSelect(size_t subjectCount, void *const subjects[static subjectCount])
+{
+	const char *path = NULL;
+
+	// the subject sharing the old build's file name, or the only one
+	for(size_t i = 0; i < subjectCount; ++i)
+	{
+		struct link_map *lm;
+
+		if(dlinfo(subjects[i], RTLD_DI_LINKMAP, &lm) == 0
+			&& (subjectCount == 1 || strcmp(baseName(lm->l_name), baseName(options.affectedBy)) == 0))
+			path = lm->l_name;
+	}
+
+	if(path == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Can't compare") " '%s': No subject of the same name is loaded\n", options.affectedBy);
+		return false;
+	}
+
+	struct Image old, new;
+
+	if(! mapImage(options.affectedBy, &old))
+		return false;
+	if(! mapImage(path, &new))
+	{
+		munmap((void*)old.file, old.size);
+		return false;
+	}
+
+	const char **changed, *internal;
+	size_t changedCount = diffImages(&old, &new, &changed, &internal);
+	bool ok = changedCount != (size_t)-1;
+
+	if(! ok)
+		fprintf(stderr, RED_BOLD("Can't compare") " '%s': malloc() failed\n", options.affectedBy);
+	else if(internal)
+		printf("Symbol '%s' of %s, which it uses itself, changed, running every test object\n", internal, path);
+	else
+	{
+		qsort(changed, changedCount, sizeof(char*), _cmp_name);
+		size_t total = 0, affected = 0;
+
+		for(size_t i = 0; options.verbose && i < changedCount; ++i)
+			printf("Changed: %s\n", changed[i]);
+
+		for(size_t i = 0; i < dlCount; ++i)
+		{
+			if(! (dls[i].handle || dls[i].lazy))
+				continue;
+
+			dls[i].unaffected = !importsAny(&dls[i], changedCount, changed);
+			++total;
+			affected += !dls[i].unaffected;
+		}
+
+		printf("%zu %s of %s changed since %s, running %zu of %zu test %s that import them\n",
+			CONJUGATE(changedCount, "symbol"), path, options.affectedBy, affected, CONJUGATE(total, "object"));
+	}
+
+	free(changed);
+	munmap((void*)old.file, old.size);
+	munmap((void*)new.file, new.size);
+	return ok;
+}
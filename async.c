@@ -0,0 +1,476 @@
+/* ASYNC_TEST(): Runs many variants of a test concurrently on one thread, each on its own stack,
+	while their I/O is carried out by an io_uring instance.
+*/
+#include "ccheck.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/** The size of each coroutine's stack. Only touched pages are backed by memory. */
+#define STACK_SIZE (256 << 10)
+/** The size of the stack signal handlers run on while coroutines run, so that a coroutine overflowing its stack can fail */
+#define ALT_STACK_SIZE (64 << 10)
+/** The most submission queue entries io_uring_setup() accepts, and thus the most variants in flight */
+#define MAX_RING_ENTRIES 32768
+
+/** A variant in flight */
+struct Coroutine
+{
+	ucontext_t context;
+	/** mmap()ed stack, including a guard page at its lower end */
+	void *stack;
+	/** The state of the variant while another one is running */
+	struct TestState state;
+	/** The output of the variant under `--capture-output`, since variants on one thread interleave */
+	struct Capture capture;
+
+	/** [0 ; typeCount) -> provider each argument type was taken from */
+	size_t providers[MAX_ARITY];
+	/** [0 ; arity) -> index of each argument within its provider */
+	size_t indices[MAX_ARITY];
+	/** [0 ; arity) -> the argument values */
+	const void *args[MAX_ARITY];
+
+	/** Whether the slot holds a variant that hasn't finished yet */
+	bool busy;
+	/** Whether the variant waits for the completion of an I/O request */
+	bool waiting;
+	/** Whether the variant finished */
+	bool done;
+	/** Whether the variant failed, with the reason in `state.message` */
+	bool failed;
+	/** The result of the last I/O request */
+	ssize_t result;
+};
+
+/** An io_uring instance, mapped without liburing */
+struct Ring
+{
+	int fd;
+	void *sqMap, *cqMap;
+	size_t sqMapSize, cqMapSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+
+	unsigned *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+	/** The number of queued requests not yet passed to the kernel */
+	unsigned unsubmitted;
+};
+
+/** The ring of the calling thread while it runs an async test. `fd` is -1 if io_uring is unavailable. */
+static __thread struct Ring *ring = NULL;
+/** The variant currently running on the calling thread, or NULL outside of coroutines */
+static __thread struct Coroutine *current = NULL;
+/** The context of the scheduler loop of the calling thread */
+static __thread ucontext_t scheduler;
+/** Set once the unavailability of io_uring was reported */
+static bool warned = false;
+
+/** Sets up a ring with at least `entries` submission slots
+	@returns false if io_uring is unavailable
+ */
+static bool ringOpen(struct Ring *r, unsigned entries)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+	r->fd = syscall(__NR_io_uring_setup, entries, &p);
+
+	if(r->fd < 0)
+	{
+		if(! __atomic_exchange_n(&warned, true, __ATOMIC_RELAXED))
+			fprintf(stderr, YELLOW("io_uring is unavailable, async tests perform their I/O synchronously: io_uring_setup(): %s\n"), strerror(errno));
+
+		return false;
+	}
+
+	r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if(p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sqMapSize = r->cqMapSize = r->sqMapSize > r->cqMapSize ? r->sqMapSize : r->cqMapSize;
+
+	r->sqMap = mmap(NULL, r->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->cqMap = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sqMap
+		: mmap(NULL, r->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+	if(r->sqMap == MAP_FAILED || r->cqMap == MAP_FAILED || r->sqes == MAP_FAILED)
+	{
+		fprintf(stderr, YELLOW("Couldn't map io_uring, async tests perform their I/O synchronously: mmap(): %s\n"), strerror(errno));
+
+		if(r->sqes != MAP_FAILED)
+			munmap(r->sqes, r->sqesSize);
+		if(r->cqMap != MAP_FAILED && r->cqMap != r->sqMap)
+			munmap(r->cqMap, r->cqMapSize);
+		if(r->sqMap != MAP_FAILED)
+			munmap(r->sqMap, r->sqMapSize);
+
+		close(r->fd);
+		r->fd = -1;
+		return false;
+	}
+
+	r->sqTail = (void*)((char*)r->sqMap + p.sq_off.tail);
+	r->sqMask = (void*)((char*)r->sqMap + p.sq_off.ring_mask);
+	r->sqArray = (void*)((char*)r->sqMap + p.sq_off.array);
+	r->cqHead = (void*)((char*)r->cqMap + p.cq_off.head);
+	r->cqTail = (void*)((char*)r->cqMap + p.cq_off.tail);
+	r->cqMask = (void*)((char*)r->cqMap + p.cq_off.ring_mask);
+	r->cqes = (void*)((char*)r->cqMap + p.cq_off.cqes);
+
+	return true;
+}
+
+static void ringClose(struct Ring *r)
+{
+	if(r->fd < 0)
+		return;
+
+	munmap(r->sqes, r->sqesSize);
+
+	if(r->cqMap != r->sqMap)
+		munmap(r->cqMap, r->cqMapSize);
+
+	munmap(r->sqMap, r->sqMapSize);
+	close(r->fd);
+}
+
+/** Passes queued requests to the kernel
+	@param wait Whether to block until at least one request completed
+ */
+static void ringEnter(struct Ring *r, bool wait)
+{
+	for(;;)
+	{
+		int n = syscall(__NR_io_uring_enter, r->fd, r->unsubmitted, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+
+		if(n >= 0)
+		{
+			r->unsubmitted -= n;
+			return;
+		}
+		if(errno != EINTR)
+		{
+			fprintf(stderr, RED_BOLD("io_uring_enter() failed") ": %s\n", strerror(errno));
+			_exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/** Hands every completed request back to the variant that issued it */
+static void ringReap(struct Ring *r)
+{
+	unsigned head = *r->cqHead;
+
+	for(; head != __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE); ++head)
+	{
+		const struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+		struct Coroutine *co = (struct Coroutine*)(uintptr_t)cqe->user_data;
+
+		co->result = cqe->res;
+		co->waiting = false;
+	}
+
+	__atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+}
+
+/** Suspends the current variant, returning to the scheduler */
+static void suspend(void)
+{
+	struct Coroutine *co = current;
+	co->state = runningTest;
+	swapcontext(&co->context, &scheduler);
+}
+
+/** Queues a read or write for the current variant and suspends it until the request completed
+	@returns The result of the request
+ */
+static ssize_t submit(uint8_t opcode, int fd, const void *buf, size_t n, off_t offset)
+{
+	struct Ring *r = ring;
+	unsigned tail = *r->sqTail, idx = tail & *r->sqMask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	// every variant has at most one request in flight, and the ring has a slot for each of them
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = n;
+	sqe->off = offset;
+	sqe->user_data = (uintptr_t)current;
+	r->sqArray[idx] = idx;
+	__atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+	++r->unsubmitted;
+
+	current->waiting = true;
+	suspend();
+	return current->result;
+}
+
+ssize_t asyncRead(int fd, void *buf, size_t n, off_t offset)
+{
+	if(current == NULL || ring->fd < 0)
+	{
+		ssize_t r = pread(fd, buf, n, offset);
+		return r < 0 ? -errno : r;
+	}
+
+	return submit(IORING_OP_READ, fd, buf, n, offset);
+}
+
+ssize_t asyncWrite(int fd, const void *buf, size_t n, off_t offset)
+{
+	if(current == NULL || ring->fd < 0)
+	{
+		ssize_t r = pwrite(fd, buf, n, offset);
+		return r < 0 ? -errno : r;
+	}
+
+	return submit(IORING_OP_WRITE, fd, buf, n, offset);
+}
+
+void asyncYield(void)
+{
+	if(current)
+		suspend();
+}
+
+/** The test currently driven by the scheduler of the calling thread */
+static __thread const struct Test *currentTest;
+
+/** Entry point of every coroutine */
+static void coroutineMain(void)
+{
+	struct Coroutine *co = current;
+	co->failed = !runVariant(currentTest->func, currentTest->sig.arity, co->args);
+	co->done = true;
+	co->state = runningTest;
+	// returns to `scheduler` through uc_link
+}
+
+/** Switches to a variant until it suspends or finishes */
+static void resume(struct Coroutine *co)
+{
+	struct TestState saved = runningTest;
+	runningTest = co->state;
+	current = co;
+	swapcontext(&scheduler, &co->context);
+	current = NULL;
+	runningTest = saved;
+}
+
+/** Prints and records the failure of a variant */
+static void reportFailure(struct DL *dl, const struct Test *test, struct ProviderBucket *const buckets[], const struct Coroutine *co)
+{
+	format_f formats[MAX_ARITY];
+	char originBuf[MAX_ARITY][256];
+	const char *origins[MAX_ARITY];
+	const struct Provider *providers[MAX_ARITY];
+	struct TestState saved = runningTest;
+
+	for(unsigned int i = 0; i < test->sig.arity; ++i)
+	{
+		size_t ti = test->sig.argTypeIndices[i];
+		const struct Provider *p = providers[i] = &buckets[ti]->providers[co->providers[ti]];
+
+		formats[i] = p->format;
+		snprintf(originBuf[i], sizeof(originBuf[i]), "%s::%s #%zu", p->dlName, p->name, co->indices[i]);
+		origins[i] = originBuf[i];
+	}
+
+	// printFailure() takes the reason from runningTest
+	runningTest = co->state;
+	printFailure(dl, test, formats, co->args, origins);
+	runningTest = saved;
+	failuresRecord(dl, test, providers, co->indices);
+}
+
+bool runAsyncTest(struct DL *dl, const struct Test *test)
+{
+	const unsigned int arity = test->sig.arity, typeCount = test->sig.typeCount;
+	const int *argTypeIndices = test->sig.argTypeIndices;
+	struct ProviderBucket *buckets[MAX_ARITY];
+	size_t bucketSizes[MAX_ARITY];
+
+	for(size_t i = 0; i < typeCount; ++i)
+	{
+		struct ProviderBucket *pb = findProvider(test->sig.argTypes[i]);
+
+		if(pb == NULL || pb->count == 0)
+		{
+			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: No providers registered for type '%s'.\n", dl->name, test->name, test->sig.argTypes[i]);
+			++dl->failed;
+			return false;
+		}
+
+		buckets[i] = pb;
+		bucketSizes[i] = pb->count;
+	}
+
+	// every variant in flight needs a submission slot of its own
+	size_t limit = options.asyncLimit < MAX_RING_ENTRIES ? options.asyncLimit : MAX_RING_ENTRIES;
+	struct Coroutine *slots = calloc(limit, sizeof(struct Coroutine));
+	/** Storage for the arguments of every slot that are computed by derived providers, `words` per argument */
+	size_t words = scratchWords(typeCount, buckets);
+	scratch_t *scratch = calloc(limit * (arity ? arity : 1) * words, sizeof(scratch_t));
+	struct Ring r;
+	// a coroutine that overflows its stack hits the guard page, and the handler needs another stack to fail the variant on
+	stack_t alt = { .ss_size = ALT_STACK_SIZE }, previous;
+	alt.ss_sp = mmap(NULL, ALT_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+
+	if(slots == NULL || scratch == NULL || alt.ss_sp == MAP_FAILED || sigaltstack(&alt, &previous))
+	{
+		fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: %s\n", dl->name, test->name,
+			slots && scratch ? "Couldn't set up a signal stack" : "malloc() failed");
+		++dl->failed;
+		free(slots);
+		free(scratch);
+
+		if(alt.ss_sp != MAP_FAILED)
+			munmap(alt.ss_sp, ALT_STACK_SIZE);
+
+		return false;
+	}
+
+	ringOpen(&r, limit);
+	ring = &r;
+	currentTest = test;
+
+	/** The variant to start next, in the same order as runSingleTest() */
+	size_t curProviders[MAX_ARITY] = {0}, curDataCounts[MAX_ARITY], curDataIndices[MAX_ARITY] = {0};
+	bool more = true, failed = false;
+	size_t inFlight = 0;
+
+	for (size_t i = 0; i < arity; ++i)
+		curDataCounts[i] = buckets[argTypeIndices[i]]->providers[0].count;
+
+	while((more && !failed) || inFlight)
+	{
+		// start new variants in every free slot
+		for(size_t s = 0; s < limit && more && !failed; ++s)
+		{
+			struct Coroutine *co = &slots[s];
+
+			if(co->busy)
+				continue;
+			if(co->stack == NULL)
+			{
+				co->stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+
+				// without its guard page, an overflow would silently overwrite the neighbouring stack
+				if(co->stack != MAP_FAILED && mprotect(co->stack, getpagesize(), PROT_NONE) != 0)
+				{
+					munmap(co->stack, STACK_SIZE);
+					co->stack = MAP_FAILED;
+				}
+
+				if(co->stack == MAP_FAILED)
+				{
+					co->stack = NULL;
+					break;
+				}
+			}
+
+			memcpy(co->providers, curProviders, sizeof(curProviders));
+			memcpy(co->indices, curDataIndices, sizeof(curDataIndices));
+
+			for (size_t i = 0; i < arity; ++i)
+				co->args[i] = locateArg(buckets[argTypeIndices[i]], curProviders[argTypeIndices[i]], curDataIndices[i], scratch + (s * arity + i) * words);
+
+			getcontext(&co->context);
+			co->context.uc_stack.ss_sp = co->stack;
+			co->context.uc_stack.ss_size = STACK_SIZE;
+			co->context.uc_link = &scheduler;
+			makecontext(&co->context, coroutineMain, 0);
+			memset(&co->state, 0, sizeof(co->state));
+			co->state.capture = &co->capture;
+			co->busy = true;
+			co->done = co->waiting = co->failed = false;
+			++inFlight;
+			++dl->variants;
+			telemetryVariant();
+
+			if(! nextCombination(arity, curDataCounts, curDataIndices))
+			{
+				memset(curDataIndices, 0, sizeof(curDataIndices));
+				more = nextCombination(typeCount, bucketSizes, curProviders);
+
+				for (size_t i = 0; more && i < arity; ++i)
+					curDataCounts[i] = buckets[argTypeIndices[i]]->providers[curProviders[argTypeIndices[i]]].count;
+			}
+		}
+
+		if(inFlight == 0)
+		{
+			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: mmap() failed for a coroutine stack: %s\n", dl->name, test->name, strerror(errno));
+			failed = true;
+			++dl->failed;
+			break;
+		}
+
+		bool ran = false;
+
+		for(size_t s = 0; s < limit; ++s)
+		{
+			struct Coroutine *co = &slots[s];
+
+			if(!co->busy || co->waiting)
+				continue;
+
+			resume(co);
+			ran = true;
+
+			if(! co->done)
+				continue;
+
+			co->busy = false;
+			--inFlight;
+
+			// only the first failure is reported, as with TEST(), but variants in flight still have to finish
+			if(co->failed && !failed)
+			{
+				failed = true;
+				++dl->failed;
+				reportFailure(dl, test, buckets, co);
+			}
+		}
+
+		if(r.fd >= 0 && (r.unsubmitted || !ran))
+			ringEnter(&r, !ran);
+		if(r.fd >= 0)
+			ringReap(&r);
+	}
+
+	for(size_t s = 0; s < limit; ++s)
+	{
+		if(slots[s].stack)
+			munmap(slots[s].stack, STACK_SIZE);
+
+		captureFree(&slots[s].capture);
+	}
+
+	free(slots);
+	free(scratch);
+	ringClose(&r);
+	ring = NULL;
+	sigaltstack(&previous, NULL);
+	munmap(alt.ss_sp, ALT_STACK_SIZE);
+
+	if(! failed)
+		++dl->succeeded;
+
+	return !failed;
+}
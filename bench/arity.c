@@ -0,0 +1,48 @@
+/* Empty tests of every arity up to 8, taking 4^arity variants each, which measures the dispatch of variants */
+#include "interface.h"
+
+#include <stdint.h>
+
+TEST(arity0)
+{
+}
+
+TEST(arity1, uint32_t, a)
+{
+	(void)a;
+}
+
+TEST(arity2, uint32_t, a, uint32_t, b)
+{
+	(void)a, (void)b;
+}
+
+TEST(arity3, uint32_t, a, uint32_t, b, uint32_t, c)
+{
+	(void)a, (void)b, (void)c;
+}
+
+TEST(arity4, uint32_t, a, uint32_t, b, uint32_t, c, uint32_t, d)
+{
+	(void)a, (void)b, (void)c, (void)d;
+}
+
+TEST(arity5, uint32_t, a, uint32_t, b, uint32_t, c, uint32_t, d, uint32_t, e)
+{
+	(void)a, (void)b, (void)c, (void)d, (void)e;
+}
+
+TEST(arity6, uint32_t, a, uint32_t, b, uint32_t, c, uint32_t, d, uint32_t, e, uint32_t, f)
+{
+	(void)a, (void)b, (void)c, (void)d, (void)e, (void)f;
+}
+
+TEST(arity7, uint32_t, a, uint32_t, b, uint32_t, c, uint32_t, d, uint32_t, e, uint32_t, f, uint32_t, g)
+{
+	(void)a, (void)b, (void)c, (void)d, (void)e, (void)f, (void)g;
+}
+
+TEST(arity8, uint32_t, a, uint32_t, b, uint32_t, c, uint32_t, d, uint32_t, e, uint32_t, f, uint32_t, g, uint32_t, h)
+{
+	(void)a, (void)b, (void)c, (void)d, (void)e, (void)f, (void)g, (void)h;
+}
@@ -0,0 +1,202 @@
+/* Measures the overhead of ccheck itself by running it against the synthetic objects built by `make bench`.
+	Usage: bench CCHECK DIR, where DIR contains the benchmark objects.
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Every scenario is run this often, keeping the fastest run, since noise only ever adds time */
+#define REPEAT 5
+/** The number of symbols exported by symbols.so, see the makefile */
+#define SYMBOL_COUNT 20000
+/** The number of tests in thousand.so, see the makefile */
+#define TEST_COUNT 1000
+
+/** A run of ccheck against some of the benchmark objects */
+struct Scenario
+{
+	const char *name;
+	/** NULL-terminated list of objects in the benchmark directory, given after `--` */
+	const char *objects[3];
+
+	/** The fastest wall-clock time in seconds */
+	double seconds;
+	/** The number of variants reported by ccheck */
+	size_t variants;
+	/** The highest peak resident set size in KiB */
+	long maxRss;
+};
+
+/** @returns The current CLOCK_MONOTONIC time in seconds */
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/** Runs ccheck once, reading the number of variants from its summary
+	@returns false and prints an error message if ccheck couldn't be run or reported failures
+ */
+static bool runOnce(const char *ccheck, const char *dir, struct Scenario *s)
+{
+	char objects[3][PATH_MAX];
+	const char *argv[16] = { ccheck, "--" };
+	int argc = 2, out[2];
+
+	for(size_t i = 0; s->objects[i]; ++i)
+	{
+		snprintf(objects[i], sizeof(objects[i]), "%s/%s", dir, s->objects[i]);
+		argv[argc++] = objects[i];
+	}
+
+	if(pipe(out))
+	{
+		fprintf(stderr, "Can't run %s: pipe(): %s\n", s->name, strerror(errno));
+		return false;
+	}
+
+	double start = now();
+	pid_t pid = fork();
+
+	if(pid < 0)
+	{
+		fprintf(stderr, "Can't run %s: fork(): %s\n", s->name, strerror(errno));
+		close(out[0]);
+		close(out[1]);
+		return false;
+	}
+
+	if(pid == 0)
+	{
+		dup2(out[1], STDOUT_FILENO);
+		close(out[0]);
+		close(out[1]);
+		execv(ccheck, (char**)argv);
+		_exit(127);
+	}
+
+	close(out[1]);
+
+	// read to the end, so that ccheck never blocks on a full pipe
+	char *output = NULL, buf[4096];
+	size_t size = 0;
+	FILE *o = open_memstream(&output, &size);
+	ssize_t r;
+
+	while((r = read(out[0], buf, sizeof(buf))) > 0)
+	{
+		if(o)
+			fwrite(buf, 1, r, o);
+	}
+
+	close(out[0]);
+
+	if(o)
+		fclose(o);
+
+	int status;
+	struct rusage usage;
+
+	if(wait4(pid, &status, 0, &usage) < 0)
+	{
+		fprintf(stderr, "Can't run %s: wait4(): %s\n", s->name, strerror(errno));
+		free(output);
+		return false;
+	}
+
+	double seconds = now() - start;
+	const char *summary = output ? strstr(output, "Summary:") : NULL;
+	const char *with = summary ? strstr(summary, " with ") : NULL;
+
+	if(!WIFEXITED(status) || WEXITSTATUS(status) || with == NULL)
+	{
+		fprintf(stderr, "Running %s failed\n", s->name);
+		free(output);
+		return false;
+	}
+
+	s->variants = strtoull(with + 6, NULL, 10);
+	free(output);
+
+	if(s->seconds == 0 || seconds < s->seconds)
+		s->seconds = seconds;
+	if(usage.ru_maxrss > s->maxRss)
+		s->maxRss = usage.ru_maxrss;
+
+	return true;
+}
+
+/** Formats a rate with an SI prefix */
+static const char *rate(char *to, size_t n, double perSecond)
+{
+	const char *prefixes = " kMG";
+	size_t p = 0;
+
+	for(; perSecond >= 1000 && p < 3; ++p)
+		perSecond /= 1000;
+
+	snprintf(to, n, "%.2f%c", perSecond, prefixes[p]);
+	return to;
+}
+
+int main(int argc, char **argv)
+{
+	if(argc != 3)
+	{
+		fprintf(stderr, "Usage: %s CCHECK DIR\n", argc ? argv[0] : "bench");
+		return 1;
+	}
+
+	struct Scenario scenarios[] = {
+		{ .name = "startup", .objects = { "empty.so" } },
+		{ .name = "symbols", .objects = { "symbols.so" } },
+		{ .name = "thousand tests", .objects = { "thousand.so" } },
+		{ .name = "arity 0-8", .objects = { "provider.so", "arity.so" } },
+		{ .name = "large provider", .objects = { "provider.so", "large.so" } },
+	};
+	const size_t count = sizeof(scenarios) / sizeof(*scenarios);
+	bool ok = true;
+
+	for(size_t s = 0; ok && s < count; ++s)
+	{
+		for(size_t r = 0; ok && r < REPEAT; ++r)
+			ok = runOnce(argv[1], argv[2], &scenarios[s]);
+	}
+
+	if(! ok)
+		return 1;
+
+	printf("%-16s %10s %12s %14s %12s\n", "Scenario", "Time", "Variants", "Variants/s", "Peak RSS");
+
+	// everything beyond the startup of the empty run is attributed to the scenario itself
+	double startup = scenarios[0].seconds;
+	char buf[32];
+
+	for(size_t s = 0; s < count; ++s)
+	{
+		const struct Scenario *c = &scenarios[s];
+		double work = c->seconds - startup;
+
+		printf("%-16s %8.2fms %12zu %14s %9.1fMiB\n", c->name, c->seconds * 1e3, c->variants,
+			s && work > 0 ? rate(buf, sizeof(buf), c->variants / work) : "-", c->maxRss / 1024.0);
+	}
+
+	printf("\nStartup: %.2fms\n", startup * 1e3);
+	printf("Symbol discovery: %.1fns per symbol\n", (scenarios[1].seconds - startup) / SYMBOL_COUNT * 1e9);
+	printf("Per-test overhead: %.1fus\n", (scenarios[2].seconds - startup) / TEST_COUNT * 1e6);
+	printf("Dispatch: %s variants/s", rate(buf, sizeof(buf), scenarios[3].variants / (scenarios[3].seconds - startup)));
+	printf(" at arities 0-8, %s variants/s from a large provider\n", rate(buf, sizeof(buf), scenarios[4].variants / (scenarios[4].seconds - startup)));
+	printf("Peak RSS: %.1fMiB at startup, %.1fMiB with a large provider\n", scenarios[0].maxRss / 1024.0, scenarios[4].maxRss / 1024.0);
+
+	return 0;
+}
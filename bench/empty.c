@@ -0,0 +1,6 @@
+/* A single test without arguments, so that running it measures little beyond startup and shutdown */
+#include "interface.h"
+
+TEST(nothing)
+{
+}
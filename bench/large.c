@@ -0,0 +1,9 @@
+/* An empty test over the large provider, which measures the dispatch of many variants from a single provider and the memory of its data */
+#include "interface.h"
+
+#include <stdint.h>
+
+TEST(everyElement, uint64_t, x)
+{
+	(void)x;
+}
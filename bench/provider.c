@@ -0,0 +1,44 @@
+/* Providers for the benchmarks: a tiny one for tests of high arity, and a large one */
+#include "interface.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+PROVIDER(uint32_t, four)
+PROVIDER(uint64_t, large)
+
+/** The number of elements of `large`, i.e. 32 MiB of data */
+#define LARGE_COUNT (4u << 20)
+
+size_t four(size_t cap, uint32_t data[restrict static cap])
+{
+	if(cap < 4)
+		return 4;
+
+	for(uint32_t i = 0; i < 4; ++i)
+		data[i] = i;
+
+	return 4;
+}
+
+size_t format_uint32_t(char *to, size_t n, const uint32_t thing[restrict static 1])
+{
+	return snprintf(to, n, "%" PRIu32, *thing);
+}
+
+size_t large(size_t cap, uint64_t data[restrict static cap])
+{
+	if(cap < LARGE_COUNT)
+		return LARGE_COUNT;
+
+	for(uint64_t i = 0; i < LARGE_COUNT; ++i)
+		data[i] = i * 0x9e3779b97f4a7c15u;
+
+	return LARGE_COUNT;
+}
+
+size_t format_uint64_t(char *to, size_t n, const uint64_t thing[restrict static 1])
+{
+	return snprintf(to, n, "%" PRIu64, *thing);
+}
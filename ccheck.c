@@ -1,142 +1,73 @@
-#define _GNU_SOURCE
+#include "ccheck.h"
 
-#include <elf.h>
-#include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <dlfcn.h>
 #include <string.h>
 #include <stdlib.h>
-#include <link.h>
-#include <pthread.h>
-#include <setjmp.h>
 #include <stdarg.h>
 #include <signal.h>
 #include <errno.h>
-#include "interface.h"
-
-#define RED_BOLD(msg) "\x1B[31;1m" msg "\x1B[0m"
-#define RED(msg) "\x1B[31m" msg "\x1B[0m"
-#define YELLOW(msg) "\x1B[33m" msg "\x1B[0m"
-
-/** Conjugates an irregular noun so that is matches the number n.
-	@param n The number of items to conjugate for. Evaluated twice.
-	@param x The singular form
-	@param xs The plural form
-	@returns inputs to a printf format like "%d %s"
- */
-#define CONJUGATE3(n, x, xs) (n) , ((n) != 1 ? (xs) : (x))
-
-/** Conjugates a noun so that it matches the number n.
-	@warning Assumes a regular noun so it only adds "s"
-	@returns inputs to a printf format like "%d %s"
-*/
-#define CONJUGATE(n, x) CONJUGATE3(n, x, x "s")
-
-/** A set of typed data to be fed into tests */
-struct Provider
-{
-	/** Name of the dynamic object providing this dataset */
-	const char *dlName;
-	/** Human readable name for this data-set.
-		Determined by the second argument to the PROVIDER() macro
-	 */
-	const char *name;
-	/** Number of items in this dataset */
-	size_t count;
-	/** Actual dataset */
-	const void *data;
-	/** Formatting function */
-	format_f format;
-};
-
-/** An collection of data sets for test parameters. Forms a single-linked list. */
-struct ProviderBucket
-{
-	/** The type name of the data, as given to the PROVIDER() macro */
-	const char *type;
-	/** The size of each individual element, determined automatically via sizeof().
-		Sanity-checked between different providers.
-	 */
-	size_t elementSize;
-	/** Every data set available for this type */
-	struct Provider *providers;
-	/** The length of providers */
-	size_t count;
-	/** The next bucket for a different type. */
-	struct ProviderBucket *next;
-};
-
-/** Information on a dynamically linked object supplied as CLI argument */
-struct DL
-{
-	/** The handle returned by dlopen() */
-	void *handle;
-	/** The start of the mapped memory at ELF offset 0 */
-	const char *elfOffset;
-	/** The number of entries in symbols */
-	size_t symbolCount;
-	/** The symbol table */
-	const ElfW(Sym) *symbols;
-	/** The string table */
-	const char *strings;
-
-	/** The path used as CLI argument */
-	const char *name;
-	/** The thread executing this object's tests */
-	pthread_t runner;
-	/** Whether `runner` describes a thread running in parallel or not. */
-	bool parallel;
-	/** Whether this object contained one or more providers. */
-	bool provider;
-
-	/** The total number of times test functions from this object were called */
-	size_t variants;
-	/** The number of individual tests that succeeded
-		@note This number is tests, not test function calls / variants.
-	*/
-	size_t succeeded;
-	/** The number of individual tests that failed */
-	size_t failed;
-};
-
-typedef void (*const test_f)();
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 bool linkerErrors = false;
 struct ProviderBucket *providerRoot = NULL;
 size_t dlCount = 0;
 struct DL *dls;
 
-/** When a provider does not give a number of data points, use this instead. */
+pthread_mutex_t providerLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t providerReady = PTHREAD_COND_INITIALIZER;
+
+/** A provider that is scheduled to generate its data */
+struct ProviderJob
+{
+	struct DL *dl;
+	/** The name of the _SIZEOF_PROVIDER_* symbol */
+	const char *sizeofName;
+	/** The value of that symbol */
+	size_t size;
+	/** The bucket it will be added to */
+	struct ProviderBucket *bucket;
+	/** Whether it is a DERIVED_PROVIDER(), which has to wait for its sources */
+	bool derived;
+};
+
+/** The providers planned by planProviders() */
+static struct ProviderJob *jobs = NULL;
+static size_t jobCount = 0;
+/** The number of providers planProviders() skipped */
+static size_t skippedProviders = 0;
+
 const size_t FALLBACK_VARIANT_COUNT = 50;
 
-/** Maximum length of message on test failure. */
-#define TEST_MESSAGE_SIZE 200
-
-/** Information on the currently running test */
-__thread struct {
-	/** Whether `failTarget` is currently in a valid state */
-	bool jumpReady;
-	/** Whether `successTarget` is currently in a valid state */
-	bool successJumpReady;
-	/** a longjmp() target to continue at on test failure */
-	jmp_buf failTarget;
-	/** a longjmp() target to continue at on test success */
-	jmp_buf successTarget;
-	/** Stores a custom message to display in addition to the failed test's invocation */
-	char message[TEST_MESSAGE_SIZE];
-	/** size of `exitMask` */
-	unsigned exitMaskSize;
-	/** malloc()ed pointer to a list of exit codes */
-	int *exitMask;
-} runningTest = {0};
+__thread struct TestState runningTest = {0};
+struct Options options = {
+	.fuzzDir = "ccheck-crashes",
+	.asyncLimit = 64,
+	.checkpointInterval = 60,
+	.stressEfficiency = 50
+};
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
 
 void testFailure(const char *fmt, ...)
 {
 	va_list ls;
 	va_start(ls, fmt);
+	testFailureV(fmt, ls);
+}
+
+void testFailureV(const char *fmt, va_list ls)
+{
 	int w = vsnprintf(runningTest.message, TEST_MESSAGE_SIZE, fmt, ls);
-	va_end(ls);
 
 	if(w == TEST_MESSAGE_SIZE - 1)
 	{
@@ -266,15 +197,164 @@ bool nextCombination(size_t n, const size_t ms[static n], size_t result[static n
 	}
 }
 
+/** @returns base to the power of exp */
+static size_t power(size_t base, unsigned int exp)
+{
+	size_t r = 1;
+
+	while(exp--)
+		r *= base;
+
+	return r;
+}
+
+size_t countVariants(const struct Signature *sig, bool duplicates)
+{
+	size_t total = 1;
+
+	// every provider of a type is combined with those of the other types, and supplies all arguments of its type at once
+	for(unsigned int t = 0; t < sig->typeCount; ++t)
+	{
+		const struct ProviderBucket *b = findProvider(sig->argTypes[t]);
+		unsigned int uses = 0;
+		size_t sum = 0;
+
+		for(unsigned int i = 0; i < sig->arity; ++i)
+			uses += sig->argTypeIndices[i] == (int)t;
+
+		for(size_t i = 0; b && i < b->count; ++i)
+			sum += power(b->providers[i].count + (duplicates ? b->providers[i].duplicates : 0), uses);
+
+		if(b)
+			sum += b->pending * power(FALLBACK_VARIANT_COUNT, uses);
+
+		total *= sum;
+	}
+
+	return total;
+}
+
 /**
 	@param bucket The bucket to grab the test data from
 	@param providerIndex which provider to use from that bucket
 	@param dataPosition which item to use from that provider
+	@param scratch Receives elements of derived providers, at least `bucket->elementSize` bytes
 	@returns A pointer to the test data at the provided indices
 */
-const void *locateArg(struct ProviderBucket *bucket, size_t providerIndex, size_t dataPosition)
+const void *locateArg(struct ProviderBucket *bucket, size_t providerIndex, size_t dataPosition, void *scratch)
+{
+	const struct Provider *p = &bucket->providers[providerIndex];
+
+	if(p->derived)
+		return deriveArg(p, dataPosition, scratch);
+
+	const void *data = numaNode >= 0 && p->replicas ? p->replicas[numaNode] : p->data;
+
+	return (void*)((size_t)data  +  bucket->elementSize * dataPosition);
+}
+
+/** The number of elements of a derived provider checked by holdsPointers(), since they are computed on every access */
+#define POINTER_SAMPLE 4096
+
+/** A mapped range of the address space, as listed in /proc/self/maps */
+struct Mapping
+{
+	uintptr_t start, end;
+};
+
+/** Reads the ranges of the address space that are mapped
+	@param mappings Receives a malloc()ed list, sorted by address
+	@returns The length of `mappings`, or (size_t)-1 on failure
+ */
+static size_t readMappings(struct Mapping **mappings)
+{
+	FILE *f = fopen("/proc/self/maps", "r");
+	size_t count = 0, cap = 0;
+	char *line = NULL;
+	size_t lineCap = 0;
+	*mappings = NULL;
+
+	if(f == NULL)
+		return (size_t)-1;
+
+	while(getline(&line, &lineCap, f) > 0)
+	{
+		struct Mapping m;
+
+		if(sscanf(line, "%" SCNxPTR "-%" SCNxPTR, &m.start, &m.end) != 2)
+			continue;
+
+		if(count == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			struct Mapping *r = realloc(*mappings, cap * sizeof(struct Mapping));
+
+			if(r == NULL)
+			{
+				count = (size_t)-1;
+				break;
+			}
+
+			*mappings = r;
+		}
+
+		(*mappings)[count++] = m;
+	}
+
+	free(line);
+	fclose(f);
+	return count;
+}
+
+/** @returns Whether an address lies in any of the mapped ranges */
+static bool isMapped(uintptr_t address, size_t count, const struct Mapping mappings[static count])
+{
+	size_t low = 0, high = count;
+
+	while(low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+
+		if(address < mappings[mid].start)
+			high = mid;
+		else if(address >= mappings[mid].end)
+			low = mid + 1;
+		else
+			return true;
+	}
+
+	return false;
+}
+
+bool holdsPointers(struct ProviderBucket *b, size_t providerIndex)
 {
-	return (void*)((size_t)bucket->providers[providerIndex].data  +  bucket->elementSize * dataPosition);
+	if(strchr(b->type, '*'))
+		return true;
+	// an element holding a pointer is aligned like one, so its size is a multiple of a pointer's
+	if(b->elementSize % sizeof(uintptr_t))
+		return false;
+
+	struct Mapping *mappings;
+	size_t mappingCount = readMappings(&mappings);
+	const struct Provider *p = &b->providers[providerIndex];
+	size_t count = p->derived && p->count > POINTER_SAMPLE ? POINTER_SAMPLE : p->count;
+	scratch_t scratch[SCRATCH_WORDS(b->elementSize)];
+	bool found = mappingCount == (size_t)-1;
+
+	for(size_t i = 0; !found && i < count; ++i)
+	{
+		const char *element = locateArg(b, providerIndex, i, scratch);
+
+		for(size_t off = 0; !found && off < b->elementSize; off += sizeof(uintptr_t))
+		{
+			uintptr_t word;
+			memcpy(&word, element + off, sizeof(word));
+			found = isMapped(word, mappingCount, mappings);
+		}
+	}
+
+	free(mappings);
+	return found;
 }
 
 /** Invoked when a SIGSEGV signal is caught. */
@@ -292,17 +372,124 @@ void handleSignal(int signo)
 	longjmp(runningTest.failTarget, 1);
 }
 
-/**
-	@param func The dynamically located test function
-	@param arity The number of function arguments `func` takes
-	@param typeCount The number of unique types in the arguments of func
-	@param argTypes [0 ; typeCount) -> type names
-	@param argTypeIndices [0 ; arity) -> [0 ; typeCount)
-	@param argNames [0 ; arity) -> argument names
- */
-void runSingleTest(struct DL *dl, const char *testName, test_f func, unsigned int arity, unsigned int typeCount,
-	const char *restrict const argTypes[restrict static typeCount], const int argTypeIndices [restrict static arity], const char *restrict const argNames[restrict static arity])
+void invokeTest(test_f func, unsigned int arity, const void *const args[])
+{
+	switch(arity)
+	{
+		case MAX_ARITY:
+			func( args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7] );
+		break;
+
+		case 7:
+			func( args[0], args[1], args[2], args[3], args[4], args[5], args[6] );
+		break;
+
+		case 6:
+			func( args[0], args[1], args[2], args[3], args[4], args[5] );
+		break;
+
+		case 5:
+			func( args[0], args[1], args[2], args[3], args[4] );
+		break;
+
+		case 4:
+			func( args[0], args[1], args[2], args[3] );
+		break;
+
+		case 3:
+			func( args[0], args[1], args[2] );
+		break;
+
+		case 2:
+			func( args[0], args[1] );
+		break;
+
+		case 1:
+			func( args[0] );
+		break;
+
+		case 0:
+			func();
+		break;
+
+		default:
+			__builtin_unreachable();
+	}
+}
+
+bool runVariant(test_f func, unsigned int arity, const void *const args[])
+{
+	runningTest.exitMaskSize = 0;
+	runningTest.exitMask = NULL;
+
+	if(setjmp(runningTest.failTarget))
+	{
+		captureEnd();
+		fixtureBreak();
+		free(runningTest.exitMask);
+		runningTest.jumpReady = false;
+		runningTest.successJumpReady = false;
+		return false;
+	}
+
+	if(! setjmp(runningTest.successTarget))
+	{
+		runningTest.jumpReady = true;
+		runningTest.successJumpReady = true;
+		captureBegin();
+		fixtureReset();
+		invokeTest(func, arity, args);
+	}
+
+	captureEnd();
+	free(runningTest.exitMask);
+	runningTest.jumpReady = false;
+	runningTest.successJumpReady = false;
+	return true;
+}
+
+void printFailure(const struct DL *dl, const struct Test *test, const format_f formats[], const void *const args[], const char *const origins[])
+{
+	const size_t cap = 2048;
+	char *buffer = malloc(cap);
+
+	if(buffer == NULL)
+	{
+		printf(RED_BOLD("Failed test") " %s::%s and malloc() failed when trying to allocate an error message\n", dl->name, test->name);
+		return;
+	}
+
+	// keeps w <= cap, since snprintf() reports the length it would have written
+	#define APPEND(expr) do { w += (expr); if(w > cap) w = cap; } while(0)
+	size_t w = 0;
+	APPEND(snprintf(buffer + w, cap - w, RED_BOLD("Failed test") " %s::%s(", dl->name, test->name));
+
+	for (unsigned int i = 0; i < test->sig.arity; ++i)
+	{
+		APPEND(snprintf(buffer + w, cap - w, "%s %s = ", i ? "," : "", test->sig.argNames[i]));
+		APPEND(formats[i](buffer + w, cap - w, args[i]));
+		APPEND(snprintf(buffer + w, cap - w, " (%s)", origins[i]));
+	}
+
+	APPEND(snprintf(buffer + w, cap - w, " ): %s\n", runningTest.message));
+	#undef APPEND
+
+	if(w == cap)
+		buffer[cap - 2] = '\n';
+
+	// keeps the output of the variant right below its failure
+	flockfile(stdout);
+	fputs(buffer, stdout);
+	capturePrint();
+	funlockfile(stdout);
+	free(buffer);
+}
+
+bool runSingleTest(struct DL *dl, const struct Test *test)
 {
+	const unsigned int arity = test->sig.arity, typeCount = test->sig.typeCount;
+	const int *argTypeIndices = test->sig.argTypeIndices;
+
 	/** The buckets corresponding to the argument types */
 	struct ProviderBucket *typeBuckets[typeCount];
 	/** i |-> typeBuckets[i].count */
@@ -311,13 +498,13 @@ void runSingleTest(struct DL *dl, const char *testName, test_f func, unsigned in
 	// locate provider buckets
 	for(size_t i = 0; i < typeCount; ++i)
 	{
-		struct ProviderBucket *pb = findProvider(argTypes[i]);
+		struct ProviderBucket *pb = findProvider(test->sig.argTypes[i]);
 
-		if(pb == NULL)
+		if(pb == NULL || pb->count == 0)
 		{
-			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: No providers registered for type '%s'.\n", dl->name, testName, argTypes[i]);
+			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: No providers registered for type '%s'.\n", dl->name, test->name, test->sig.argTypes[i]);
 			++dl->failed;
-			return;
+			return false;
 		}
 
 		typeBuckets[i] = pb;
@@ -325,48 +512,59 @@ void runSingleTest(struct DL *dl, const char *testName, test_f func, unsigned in
 	}
 
 	/** i |-> The current selection of provider from typeBuckets[i] */
-	size_t curProviders[typeCount];
+	size_t curProviders[MAX_ARITY];
 	/** i |-> The number of elements provided by curProviders[argTypeIndices[i]] */
 	size_t curDataCounts[arity];
 	/** i |-> The current selection of test data index for argument i in [0; curDataCounts[i])  */
-	size_t curDataIndices[arity];
+	size_t curDataIndices[MAX_ARITY];
+	/** i |-> The value of argument i */
+	const void *args[MAX_ARITY];
+	/** i |-> Storage for argument i, if it is computed by a derived provider */
+	scratch_t scratch[arity ? arity : 1][scratchWords(typeCount, typeBuckets)];
 
 	memset(curProviders, 0, sizeof(curProviders));
+	memset(curDataIndices, 0, sizeof(curDataIndices));
+
+	size_t variantsBefore = dl->variants;
+	// continues from the position of an interrupted run, if any
+	size_t resumed = checkpointTestStart(dl, test, typeBuckets, curProviders, curDataIndices);
+	dl->variants += resumed;
+	perfReset();
 
 	if(setjmp(runningTest.failTarget))
 	{
+		captureEnd();
+		fixtureBreak();
 		runningTest.jumpReady = false;
+		runningTest.successJumpReady = false;
 		++dl->failed;
 
-		const size_t cap = 2048;
-		char *buffer = malloc(cap + 1);
+		if(perfActive)
+			perfStop();
 
-		if(buffer == NULL)
-		{
-			printf(RED_BOLD("Failed test") " %s::%s and malloc() failed when trying to allocate an error message\n", dl->name, testName);
-			return;
-		}
+		free(runningTest.exitMask);
 
-		size_t w = 0;
-		w += snprintf(buffer + w, cap - w, RED_BOLD("Failed test") " %s::%s(", dl->name, testName);
+		format_f formats[MAX_ARITY];
+		char originBuf[MAX_ARITY][256];
+		const char *origins[MAX_ARITY];
+		const struct Provider *providers[MAX_ARITY];
 
 		for (unsigned int i = 0; i < arity; ++i)
 		{
 			size_t ti = argTypeIndices[i];
-			struct ProviderBucket *pb = typeBuckets[ti];
-			struct Provider p = pb->providers[curProviders[ti]];
+			const struct Provider *p = providers[i] = &typeBuckets[ti]->providers[curProviders[ti]];
 
-			w += snprintf(buffer + w, cap - w, "%s %s = ", i ? "," : "", argNames[i]);
-			w += p.format(buffer + w, cap - w, locateArg(pb, curProviders[ti], curDataIndices[i]));
-			w += snprintf(buffer + w, cap - w, " (%s::%s #%zu)", p.dlName, p.name, curDataIndices[i]);
+			formats[i] = p->format;
+			args[i] = locateArg(typeBuckets[ti], curProviders[ti], curDataIndices[i], scratch[i]);
+			snprintf(originBuf[i], sizeof(originBuf[i]), "%s::%s #%zu", p->dlName, p->name, curDataIndices[i]);
+			origins[i] = originBuf[i];
 		}
 
-		w += snprintf(buffer + w, cap - w, " ): %s\n", runningTest.message);
+		printFailure(dl, test, formats, args, origins);
+		failuresRecord(dl, test, providers, curDataIndices);
+		perfReport(dl, test->name, dl->variants - variantsBefore);
 
-		fputs(buffer, stdout);
-		free(buffer);
-
-		return;
+		return false;
 	}
 
 	do
@@ -378,12 +576,19 @@ void runSingleTest(struct DL *dl, const char *testName, test_f func, unsigned in
 			curDataCounts[i] = typeBuckets[ti]->providers[curProviders[ti]].count;
 		}
 
-		memset(curDataIndices, 0, sizeof(curDataIndices));
+		if(! resumed)
+			memset(curDataIndices, 0, sizeof(curDataIndices));
+
+		resumed = 0;
 
 		do
 		{
-			#define arg(i) locateArg(typeBuckets[argTypeIndices[i]], curProviders[argTypeIndices[i]], curDataIndices[i])
+			checkpointVariant(dl->variants - variantsBefore, curProviders, curDataIndices);
 			++dl->variants;
+			telemetryVariant();
+
+			for (size_t i = 0; i < arity; ++i)
+				args[i] = locateArg(typeBuckets[argTypeIndices[i]], curProviders[argTypeIndices[i]], curDataIndices[i], scratch[i]);
 
 			runningTest.exitMaskSize = 0;
 			runningTest.exitMask = NULL;
@@ -394,158 +599,362 @@ void runSingleTest(struct DL *dl, const char *testName, test_f func, unsigned in
 			runningTest.jumpReady = true;
 			runningTest.successJumpReady = true;
 
-			switch(arity)
-			{
-				case MAX_ARITY:
-					func( arg(0), arg(1), arg(2), arg(3), arg(4), arg(5), arg(6), arg(7) );
-				break;
+			if(perfActive)
+				perfStart();
 
-				case 7:
-					func( arg(0), arg(1), arg(2), arg(3), arg(4), arg(5), arg(6) );
-				break;
+			captureBegin();
+			fixtureReset();
+			invokeTest(test->func, arity, args);
 
-				case 6:
-					func( arg(0), arg(1), arg(2), arg(3), arg(4), arg(5) );
-				break;
+			on_success:
+			captureEnd();
 
-				case 5:
-					func( arg(0), arg(1), arg(2), arg(3), arg(4) );
-				break;
+			if(perfActive)
+				perfStop();
 
-				case 4:
-					func( arg(0), arg(1), arg(2), arg(3) );
-				break;
+			free(runningTest.exitMask);
+			runningTest.jumpReady = false;
+			runningTest.successJumpReady = false;
+		} while(nextCombination(arity, curDataCounts, curDataIndices));
+	} while(nextCombination(typeCount, bucketSizes, curProviders));
 
-				case 3:
-					func( arg(0), arg(1), arg(2) );
-				break;
+	++dl->succeeded;
+	perfReport(dl, test->name, dl->variants - variantsBefore);
 
-				case 2:
-					func( arg(0), arg(1) );
-				break;
+	return true;
+}
 
-				case 1:
-					func( arg(0) );
-				break;
+bool parseSignature(const char *str, struct Signature *sig)
+{
+	sig->arity = 0;
+	sig->typeCount = 0;
 
-				case 0:
-					func();
-				break;
+	for(const char *cur = str; *cur; ++sig->arity)
+	{
+		if(sig->arity >= MAX_ARITY)
+			return false;
+
+		const char *type = cur;
+		cur += strlen(cur) + 1;
+		sig->argNames[sig->arity] = cur;
+		cur += strlen(cur) + 1;
 
-				default:
-					__builtin_unreachable();
+		unsigned int typeIdx = sig->typeCount;
+
+		for(unsigned int i = 0; i < sig->typeCount; ++i)
+		{
+			if(strcmp(sig->argTypes[i], type) == 0)
+			{
+				typeIdx = i;
+				break;
 			}
+		}
 
-			on_success:
-			free(runningTest.exitMask);
-			runningTest.jumpReady = false;
-			runningTest.successJumpReady = false;
+		sig->argTypeIndices[sig->arity] = typeIdx;
 
-			#undef arg
-		} while(nextCombination(arity, curDataCounts, curDataIndices));
-	} while(nextCombination(typeCount, bucketSizes, curProviders));
+		if(typeIdx == sig->typeCount)
+			sig->argTypes[sig->typeCount++] = type;
+	}
 
-	++dl->succeeded;
+	return true;
 }
 
-/** Runs every test in a dynamic object
-	@param dl A non-null loaded object
+/** Checks whether every provider for the arguments of a test finished generating data.
+	@note Must be called with `providerLock` held
  */
-void runTests(struct DL *dl)
+static bool providersReady(const struct Signature *sig)
 {
-	if(dl->symbolCount == 0 || dl->symbols == NULL || dl->strings == NULL)
+	for(unsigned int t = 0; t < sig->typeCount; ++t)
+	{
+		const struct ProviderBucket *b = findProvider(sig->argTypes[t]);
+
+		if(b && !b->complete)
+			return false;
+	}
+
+	return true;
+}
+
+/** Runs a test, starting with its variants that failed in a previous run, and registers it for fuzzing if applicable */
+static void executeTest(struct DL *dl, const struct Test *test)
+{
+	if(! fixtureEnter(dl, test))
+	{
+		++dl->failed;
+		return;
+	}
+
+	bool recorded = failuresRecorded(dl, test->name);
+
+	if(recorded && !failuresReplay(dl, test))
+		return;
+	if(options.replay)
+	{
+		dl->succeeded += recorded;
+		return;
+	}
+
+	size_t saved = dedupSaved(test);
+
+	if(saved)
+		printf("Skipping %zu duplicate %s of %s::%s\n", CONJUGATE(saved, "variant"), dl->name, test->name);
+
+	double start = now();
+	size_t variantsBefore = dl->variants;
+	bool ok = test->async ? runAsyncTest(dl, test) : runSingleTest(dl, test);
+
+	// failing tests stop early, so their duration says nothing about a full run
+	if(ok)
+		historyRecordTest(dl, test->name, dl->variants - variantsBefore, now() - start);
+	if(ok && options.fuzzDuration > 0 && test->sig.arity > 0)
+		fuzzAddTarget(dl, test);
+	if(ok && options.stressThreads && test->threadsafe)
+		stressAddTarget(dl, test);
+}
+
+/** Runs a test via executeTest(), publishing it to `--telemetry`, `--profile` and `--checkpoint` */
+static void runTest(struct DL *dl, const struct Test *test)
+{
+	if(checkpointSkip(dl, test))
 		return;
 
-	/** [0 ; typeCount) */
-	const char *argTypes[MAX_ARITY];
-	/** [0 ; arity) -> [0 ; typeCount) */
-	int argTypeIndices[MAX_ARITY];
-	/** [0 ; arity) */
-	const char *argNames[MAX_ARITY];
+	size_t failedBefore = dl->failed, variantsBefore = dl->variants;
+	telemetryTestStart(dl, test);
+	profileTestStart(dl, test);
+	executeTest(dl, test);
+	profileTestEnd();
+	telemetryTestEnd(dl->failed == failedBefore);
+	checkpointTestEnd(dl, test, dl->failed == failedBefore, dl->variants - variantsBefore);
+}
+
+size_t collectTests(struct DL *dl, struct Test **tests)
+{
+	size_t count = 0, front = 0;
+	*tests = malloc(dl->symbolCount * sizeof(struct Test));
 
+	if(*tests == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Couldn't run tests") " of %s: malloc() failed\n", dl->name);
+		++dl->failed;
+		return 0;
+	}
 
 	for(size_t i = 1; i < dl->symbolCount; ++i)
 	{
 		ElfW(Sym) s = dl->symbols[i];
 		const char *name = dl->strings + s.st_name;
-		const char *testName = name + 10;
+		struct Test test = { .name = name + 10 };
 
 		if(strncmp(name, "_SIG_TEST_", 10) != 0)
 			continue;
 
-		test_f func = (test_f)(size_t)dlsym(dl->handle, name + 4);
+		test.func = (test_f)(size_t)dlsym(dl->handle, name + 4);
 
-		if(func == NULL) {
+		if(test.func == NULL) {
 			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: Missing testing function: dlsym(): %s\n", dl->name, name, dlerror()); // dlerror in pthread, cringe
 			++dl->failed;
-			goto skip_symbol;
+			continue;
 		}
 
-		unsigned int arity = 0;
-		// <= arity
-		unsigned int typeCount = 0;
-
-		// populate argTypes, argNames, and argTypeIndices
-		for(const char *cur = dl->elfOffset + s.st_value; *cur; ++arity)
+		if(! parseSignature(dl->elfOffset + s.st_value, &test.sig))
 		{
-			if(arity >= MAX_ARITY)
-			{
-				fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: Arity is greater than the maximum of %u.\n", dl->name, name + 10, MAX_ARITY);
-				++dl->failed;
-				goto skip_symbol;
-			}
-
-			const char *type = cur;
-			cur += strlen(cur) + 1;
-			argNames[arity] = cur;
-			cur += strlen(cur) + 1;
+			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: Arity is greater than the maximum of %u.\n", dl->name, test.name, MAX_ARITY);
+			++dl->failed;
+			continue;
+		}
 
-			unsigned int typeIdx = typeCount;
+		char asyncName[strlen(name) + 3];
+		snprintf(asyncName, sizeof(asyncName), "_ASYNC%s", name + 4);
+		test.async = dlsym(dl->handle, asyncName) != NULL;
 
-			for(unsigned int i = 0; i < typeCount; ++i)
-			{
-				if(strcmp(argTypes[i], type) == 0)
-				{
-					typeIdx = i;
-					break;
-				}
-			}
+		char threadsafeName[strlen(name) + 12];
+		snprintf(threadsafeName, sizeof(threadsafeName), "_THREADSAFE%s", name + 4);
+		test.threadsafe = dlsym(dl->handle, threadsafeName) != NULL;
 
-			argTypeIndices[arity] = typeIdx;
+		char fixtureName[strlen(name) + 10];
+		snprintf(fixtureName, sizeof(fixtureName), "_FIXTURE%s", name + 4);
+		test.fixture = dlsym(dl->handle, fixtureName);
+		(*tests)[count++] = test;
 
-			if(typeIdx == typeCount)
-				argTypes[typeCount++] = type;
+		// keeps the symbol order within both groups
+		if(failuresRecorded(dl, test.name))
+		{
+			memmove(*tests + front + 1, *tests + front, (count - 1 - front) * sizeof(struct Test));
+			(*tests)[front++] = test;
 		}
-
-		runSingleTest(dl, testName, func, arity, typeCount, argTypes, argTypeIndices, argNames);
-
-		skip_symbol:;
 	}
 
-	if(dl->variants)
-	{
-		printf("\x1B[%umModule %s: Ran %zu %s with %zu %s, %zu %s\x1B[0m\n",
-			dl->failed ? 31 : 92, dl->name, CONJUGATE(dl->failed + dl->succeeded, "test"), CONJUGATE(dl->variants, "variant"), CONJUGATE(dl->failed, "failure"));
-	}
-	else if(! dl->provider)
-		printf(YELLOW("Module %s provided no data and contained no tests\n"), dl->name);
+	return count;
 }
 
-/** Wrapper for `runTests()` as a pthread entry point
-	@param _dl A non-null `struct DL` pointer
-	@returns NULL
+/** Runs every test in a dynamic object.
+	Tests whose providers are still generating data are deferred until they are complete.
+	@param dl A non-null loaded object
  */
-void *_runTests(void *_dl)
+void runTests(struct DL *dl)
 {
-	runTests(_dl);
-	return NULL;
-}
+	if(dl->symbolCount == 0 || dl->symbols == NULL || dl->strings == NULL)
+		return;
 
-/** Loads a provider from a dynamic object
-	@param sizeof_provider_name The name of the _SIZE_PROVIDER_* symbol
-	@param size The value of the const named by `sizeof_provider_name`
-	@returns true if loading succeeded
-	@returns false and prints an error message otherwise
+	perfThreadInit();
+
+	struct Test *tests;
+	size_t testCount = collectTests(dl, &tests);
+	/** Deferred tests are moved to the start of `tests` */
+	size_t deferredCount = 0;
+
+	for(size_t i = 0; i < testCount; ++i)
+	{
+		pthread_mutex_lock(&providerLock);
+		bool ready = providersReady(&tests[i].sig);
+		pthread_mutex_unlock(&providerLock);
+
+		if(ready)
+			runTest(dl, &tests[i]);
+		else
+			tests[deferredCount++] = tests[i];
+	}
+
+	while(deferredCount)
+	{
+		pthread_mutex_lock(&providerLock);
+		size_t next;
+
+		for(;;)
+		{
+			for(next = 0; next < deferredCount && !providersReady(&tests[next].sig); ++next);
+
+			if(next < deferredCount)
+				break;
+
+			pthread_cond_wait(&providerReady, &providerLock);
+		}
+
+		pthread_mutex_unlock(&providerLock);
+
+		struct Test test = tests[next];
+		tests[next] = tests[--deferredCount];
+		runTest(dl, &test);
+	}
+
+	free(tests);
+	fixtureRelease(dl);
+	perfThreadClose();
+
+	if(dl->variants)
+	{
+		printf("\x1B[%umModule %s: Ran %zu %s with %zu %s, %zu %s\x1B[0m\n",
+			dl->failed ? 31 : 92, dl->name, CONJUGATE(dl->failed + dl->succeeded, "test"), CONJUGATE(dl->variants, "variant"), CONJUGATE(dl->failed, "failure"));
+	}
+	else if(!dl->provider && !options.replay)
+		printf(YELLOW("Module %s provided no data and contained no tests\n"), dl->name);
+}
+
+/** The queue of modules shared by the workers of runModules() */
+struct ModuleQueue
+{
+	struct DL *const *modules;
+	size_t count;
+	/** The index of the next module to run, advanced atomically */
+	size_t next;
+	/** The number of workers started so far, advanced atomically */
+	size_t workers;
+};
+
+/** Runs modules from a queue until it is empty, as a pthread entry point
+	@param _q A non-null `struct ModuleQueue` pointer
+	@returns NULL
+ */
+void *_runModuleQueue(void *_q)
+{
+	struct ModuleQueue *q = _q;
+	size_t index = __atomic_fetch_add(&q->workers, 1, __ATOMIC_RELAXED);
+	telemetryThreadInit(index);
+	profileThreadInit();
+
+	if(options.pin)
+		numaPin(index);
+
+	for(size_t i; (i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->count;)
+	{
+		struct DL *dl = q->modules[i];
+		double start = now();
+
+		if(dl->lazy && !openLazy(dl))
+			continue;
+
+		runTests(dl);
+
+		if(dl->lazy)
+			closeLazy(dl);
+
+		dl->duration = now() - start;
+
+		// runs cut short by failures or --replay would skew the estimate
+		if(! dl->failed && ! options.replay)
+			historyRecordModule(dl);
+	}
+
+	telemetryThreadClose();
+	profileThreadClose();
+	captureThreadClose();
+
+	if(options.pin)
+		numaUnpin();
+
+	return NULL;
+}
+
+bool registerProvider(const char *type, size_t size, const struct Provider *p)
+{
+	struct ProviderBucket *b = findProvider(type);
+	bool newB = false;
+
+	#define checkMalloc(ptr, ...) if(ptr == NULL) { fprintf(stderr, YELLOW("Failed to load provider %s::%s: Malloc failure\n"), p->dlName, p->name); __VA_ARGS__; return false; }
+
+	if(!b)
+	{
+		newB = true;
+		b = malloc(sizeof(struct ProviderBucket));
+		checkMalloc(b)
+
+		b->count = 0;
+		b->elementSize = size;
+		b->next = NULL;
+		b->providers = NULL;
+		b->pending = 0;
+		b->complete = true;
+		// copied since the bucket may outlive the provider's object
+		b->type = strdup(type);
+		checkMalloc(b->type, free(b))
+	}
+	else if(b->elementSize != size)
+	{
+		fprintf(stderr, YELLOW("Failed to load provider '%s': Size mismatch between other %s providers\n"), p->name, type);
+		return false;
+	}
+
+	struct Provider *np = realloc(b->providers, sizeof(struct Provider) * (b->count + 1));
+	checkMalloc(np, if(newB) { free((void*)b->type); free(b); } );
+	#undef checkMalloc
+
+	np[b->count++] = *p;
+	b->providers = np;
+
+	if(newB)
+	{
+		b->next = providerRoot;
+		providerRoot = b;
+	}
+
+	return true;
+}
+
+/** Loads a provider from a dynamic object
+	@param sizeof_provider_name The name of the _SIZE_PROVIDER_* symbol
+	@param size The value of the const named by `sizeof_provider_name`
+	@returns true if loading succeeded
+	@returns false and prints an error message otherwise
  */
 bool loadOneProvider(struct DL *dl, const char *sizeof_provider_name, size_t size)
 {
@@ -555,7 +964,6 @@ bool loadOneProvider(struct DL *dl, const char *sizeof_provider_name, size_t siz
 		if(varname == NULL) { fprintf(stderr, YELLOW("Failed to load provider %s::%s: Missing symbol '%s': %s\n"), dl->name, name, symbol, dlerror()); return false; }
 
 	chkDlsym(const char*, type, sizeof_provider_name + 7) // cut off _SIZEOF
-	chkDlsym(provider_f, prov, name) // cut off _SIZEOF
 
 	char nameBuf[200] = "format_";
 	strncat(nameBuf, type, sizeof(nameBuf) - 1);
@@ -567,8 +975,19 @@ bool loadOneProvider(struct DL *dl, const char *sizeof_provider_name, size_t siz
 			*b = '_';
 	}
 
+	// test objects deriving from the providers of other objects usually lack the formatter, which deriveProvider() borrows then
+	if(isDerived(dl, name))
+		return deriveProvider(dl, name, type, size, (format_f)(size_t)dlsym(dl->handle, nameBuf));
+
 	chkDlsym(format_f, fmt, nameBuf);
-	void *buf = NULL;
+
+	chkDlsym(provider_f, prov, name)
+	size_t n;
+	// a resumed run reuses the data of the interrupted one, which randomized providers couldn't reproduce
+	void *buf = options.resume ? checkpointTakeProvider(dl->name, name, size, &n) : NULL;
+
+	if(buf)
+		goto loaded;
 
 	if(setjmp(runningTest.failTarget))
 	{
@@ -581,7 +1000,7 @@ bool loadOneProvider(struct DL *dl, const char *sizeof_provider_name, size_t siz
 	}
 
 	runningTest.jumpReady = true;
-	size_t n = prov(0, NULL);
+	n = prov(0, NULL);
 	runningTest.jumpReady = false;
 
 	if(n == 0)
@@ -612,54 +1031,47 @@ bool loadOneProvider(struct DL *dl, const char *sizeof_provider_name, size_t siz
 		n = m;
 	}
 
-	struct ProviderBucket *b = findProvider(type);
-	bool newB = false;
-
-	if(!b)
-	{
-		newB = true;
-		b = malloc(sizeof(struct ProviderBucket));
-		checkMalloc(b, free(buf))
-
-		b->count = 0;
-		b->elementSize = size;
-		b->next = NULL;
-		b->providers = NULL;
-		b->type = type;
-	}
-	else if(b->elementSize != size)
-	{
-		fprintf(stderr, YELLOW("Failed to load provider '%s': Size mismatch between other %s providers\n"), name, type);
-		free(buf);
-		return false;
-	}
-
-	struct Provider *np = realloc(b->providers, sizeof(struct Provider) * (b->count + 1));
-	checkMalloc(np, free(buf); if(newB) free(b); );
-
-	np[b->count++] = (struct Provider) {
+	loaded:;
+	struct Provider p = {
 		.count = n,
 		.data = buf,
 		.dlName = dl->name,
 		.name = name,
 		.format = fmt
 	};
-	b->providers = np;
 
-	if(newB)
+	if(! registerProvider(type, size, &p))
 	{
-		b->next = providerRoot;
-		providerRoot = b;
+		free(buf);
+		return false;
 	}
 
 	return true;
 }
 
-/** Searches a dynamic objet for providers
-	@returns The number of providers found */
-size_t loadProviders(struct DL *dl)
+/** @returns Whether `dl` already supplied a provider with the given type and name */
+bool providerLoaded(const struct DL *dl, const char *type, const char *name)
 {
-	size_t count = 0;
+	const struct ProviderBucket *b = findProvider(type);
+
+	for(size_t i = 0; b && i < b->count; ++i)
+	{
+		if(b->providers[i].dlName == dl->name && strcmp(b->providers[i].name, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/** Plans the providers of a dynamic objet that produce one of the given types.
+	Creates their buckets in advance, so that tests can wait for them.
+	Providers that are already loaded are left alone.
+	@param types [0 ; typeCount) -> the type names some test requires
+	@returns false if memory ran out
+ */
+static bool planObjectProviders(struct DL *dl, size_t typeCount, const char *const types[static typeCount])
+{
+	size_t found = 0;
 
 	for(size_t i = 1; i < dl->symbolCount; ++i)
 	{
@@ -669,25 +1081,284 @@ size_t loadProviders(struct DL *dl)
 		if(strncmp(name, "_SIZEOF_PROVIDER_", 17) != 0)
 			continue;
 
-		if(loadOneProvider(dl, name, *(const size_t*)(dl->elfOffset + s.st_value)))
+		++found;
+		size_t size = *(const size_t*)(dl->elfOffset + s.st_value);
+		const char *type = dlsym(dl->handle, name + 7);
+		size_t t = 0;
+
+		while(type && t < typeCount && strcmp(types[t], type) != 0)
+			++t;
+
+		if(type && t == typeCount)
+		{
+			if(options.verbose)
+				printf("Skipped provider %s::%s: No test uses type '%s'\n", dl->name, name + 17, type);
+
+			++skippedProviders;
+			continue;
+		}
+		if(type && providerLoaded(dl, type, name + 17))
+			continue;
+
+		// a missing type symbol is reported by loadOneProvider()
+		struct ProviderBucket *b = type ? findProvider(type) : NULL;
+
+		if(type && !b)
+		{
+			b = calloc(1, sizeof(struct ProviderBucket));
+
+			if(b == NULL || (b->type = strdup(type)) == NULL)
+			{
+				free(b);
+				return false;
+			}
+
+			b->elementSize = size;
+			b->next = providerRoot;
+			providerRoot = b;
+		}
+
+		struct ProviderJob *j = realloc(jobs, (jobCount + 1) * sizeof(struct ProviderJob));
+
+		if(j == NULL)
+			return false;
+
+		jobs = j;
+		jobs[jobCount++] = (struct ProviderJob){ .dl = dl, .sizeofName = name, .size = size, .bucket = b, .derived = isDerived(dl, name + 17) };
+
+		if(b)
+		{
+			++b->pending;
+			b->complete = false;
+		}
+	}
+
+	dl->provider = found > 0;
+	return true;
+}
+
+/** Orders jobs so that buckets with few providers complete first, keeping jobs for the same bucket together */
+static int _cmp_job(const void *_l, const void *_r)
+{
+	const struct ProviderJob *l = _l, *r = _r;
+
+	// derived providers go last, since they need their sources
+	if(l->derived != r->derived)
+		return l->derived - r->derived;
+
+	size_t lp = l->bucket ? l->bucket->pending : 0, rp = r->bucket ? r->bucket->pending : 0;
+
+	if(lp != rp)
+		return lp < rp ? -1 : 1;
+	if(l->bucket != r->bucket)
+		return (uintptr_t)l->bucket < (uintptr_t)r->bucket ? -1 : 1;
+
+	return (uintptr_t)l < (uintptr_t)r ? -1 : (uintptr_t)l > (uintptr_t)r;
+}
+
+/** Adds a type name to a list, unless it is already contained
+	@returns false if memory ran out
+ */
+static bool addType(const char ***types, size_t *count, size_t *cap, const char *type)
+{
+	for(size_t t = 0; t < *count; ++t)
+	{
+		if(strcmp((*types)[t], type) == 0)
+			return true;
+	}
+
+	if(*count == *cap)
+	{
+		const char **n = realloc(*types, (*cap *= 2) * sizeof(char*));
+
+		if(n == NULL)
+			return false;
+
+		*types = n;
+	}
+
+	(*types)[(*count)++] = type;
+	return true;
+}
+
+void planProviders(void)
+{
+	size_t typeCount = 0, typeCap = 16;
+	const char **types = malloc(typeCap * sizeof(char*));
+
+	if(types == NULL)
+		goto oom;
+
+	// collect every type used by any test, before generating any data
+	for(size_t d = 0; d < dlCount; ++d)
+	{
+		for(size_t i = 1; (dls[d].handle || dls[d].lazy) && !dls[d].unaffected && i < dls[d].symbolCount; ++i)
+		{
+			const char *name = dls[d].strings + dls[d].symbols[i].st_name;
+			struct Signature sig;
+
+			if(strncmp(name, "_SIG_TEST_", 10) != 0 || !parseSignature(dls[d].elfOffset + dls[d].symbols[i].st_value, &sig))
+				continue;
+
+			for(unsigned int a = 0; a < sig.typeCount; ++a)
+			{
+				if(! addType(&types, &typeCount, &typeCap, sig.argTypes[a]))
+					goto oom;
+			}
+		}
+	}
+
+	// derived providers need their sources, even if no test takes their type
+	for(bool added = true; added;)
+	{
+		added = false;
+
+		for(size_t d = 0; d < dlCount; ++d)
+		{
+			for(size_t i = 1; dls[d].handle && i < dls[d].symbolCount; ++i)
+			{
+				const char *name = dls[d].strings + dls[d].symbols[i].st_name, *type, *missing;
+
+				if(strncmp(name, "_PROVIDER_", 10) != 0 || (type = dlsym(dls[d].handle, name)) == NULL
+					|| (missing = deriveMissingType(&dls[d], name + 10, type, typeCount, types)) == NULL)
+					continue;
+				if(! addType(&types, &typeCount, &typeCap, missing))
+					goto oom;
+
+				added = true;
+			}
+		}
+	}
+
+	skippedProviders = 0;
+
+	for(size_t d = 0; d < dlCount; ++d)
+	{
+		if(dls[d].handle && !planObjectProviders(&dls[d], typeCount, types))
+			goto oom;
+	}
+
+	free(types);
+
+	for(struct ProviderBucket *b = providerRoot; b; b = b->next)
+		b->complete = b->pending == 0;
+
+	qsort(jobs, jobCount, sizeof(struct ProviderJob), _cmp_job);
+	return;
+
+	oom:
+	fprintf(stderr, RED_BOLD("Failed to plan providers") ": Malloc failure\n");
+	linkerErrors = true;
+	free(types);
+}
+
+void generateProviders(void)
+{
+	size_t count = 0;
+
+	for(size_t i = 0; i < jobCount; ++i)
+	{
+		struct ProviderJob *j = &jobs[i];
+
+		// derived providers may depend on each other, so one whose sources are loaded goes first
+		if(j->derived && !deriveReady(j->dl, j->sizeofName + 17))
+		{
+			for(size_t k = i + 1; k < jobCount; ++k)
+			{
+				if(deriveReady(jobs[k].dl, jobs[k].sizeofName + 17))
+				{
+					struct ProviderJob tmp = *j;
+					*j = jobs[k];
+					jobs[k] = tmp;
+					break;
+				}
+			}
+		}
+
+		if(loadOneProvider(j->dl, j->sizeofName, j->size))
 			++count;
 		else
 			linkerErrors = true;
+
+		if(j->bucket == NULL)
+			continue;
+
+		pthread_mutex_lock(&providerLock);
+
+		if(--j->bucket->pending == 0)
+		{
+			dedupBucket(j->bucket);
+			numaReplicate(j->bucket);
+			j->bucket->complete = true;
+			pthread_cond_broadcast(&providerReady);
+		}
+
+		pthread_mutex_unlock(&providerLock);
 	}
 
-	dl->provider = count > 0;
+	if(jobCount || skippedProviders)
+	{
+		if(skippedProviders)
+			printf("Generated %zu %s, skipped %zu unused.\n", CONJUGATE(count, "provider"), skippedProviders);
+		else
+			printf("Generated %zu %s.\n", CONJUGATE(count, "provider"));
+	}
 
-	return count;
+	free(jobs);
+	jobs = NULL;
+	jobCount = 0;
+	skippedProviders = 0;
+}
+
+void unloadProviders(const struct DL *dl)
+{
+	for(struct ProviderBucket *b = providerRoot; b; b = b->next)
+	{
+		size_t kept = 0;
+
+		for(size_t i = 0; i < b->count; ++i)
+		{
+			if(b->providers[i].dlName == dl->name)
+			{
+				numaRelease(&b->providers[i], b->elementSize);
+				free((void*)b->providers[i].data);
+				free(b->providers[i].sources);
+			}
+			else
+				b->providers[kept++] = b->providers[i];
+		}
+
+		b->count = kept;
+	}
+
+	// derived providers of other objects may have used the removed ones
+	deriveRelink();
+
+	for(struct ProviderBucket **link = &providerRoot; *link;)
+	{
+		struct ProviderBucket *b = *link;
+
+		if(b->count)
+		{
+			link = &b->next;
+			continue;
+		}
+
+		*link = b->next;
+		free(b->providers);
+		free((void*)b->type);
+		free(b);
+	}
 }
 
 /** Initializes a DL reference
 	@param handle A non-null pointer returned by dlopen()
 	@param name A name identifying that dynamic object
+	@param out Receives the DL reference
 	@returns false and prints an error message on failure
 */
-bool loadDL(void *handle, const char *name)
+bool loadDL(void *handle, const char *name, struct DL *out)
 {
-	bool success = true;
 	struct link_map *lm;
 	int e = dlinfo(handle, RTLD_DI_LINKMAP, &lm);
 
@@ -696,9 +1367,17 @@ bool loadDL(void *handle, const char *name)
 		fprintf(stderr, RED_BOLD("Error loading") " '%s': dlinfo(): %s\n", name, dlerror());
 		return false;
 	}
+	if(! loadLinkMap(lm, name, out))
+		return false;
+
+	out->handle = handle;
+	return true;
+}
 
+bool loadLinkMap(const struct link_map *lm, const char *name, struct DL *out)
+{
+	bool success = true;
 	struct DL dl = {
-		.handle = handle,
 		.name = name,
 		.elfOffset = (void*)lm->l_addr
 	};
@@ -792,37 +1471,497 @@ bool loadDL(void *handle, const char *name)
 	}
 
 	if(success)
-		dls[dlCount++] = dl;
+		*out = dl;
 
 	return success;
 }
 
+void *openSubject(const char *path)
+{
+	void *handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+
+	if(handle == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Error loading")" '%s': %s\n", path, dlerror());
+		linkerErrors = true;
+	}
+
+	return handle;
+}
+
+bool openModule(const char *path, struct DL *dl)
+{
+	*dl = (struct DL){ .name = path };
+	void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+	if(handle == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Error loading")" '%s': %s\n", path, dlerror());
+		linkerErrors = true;
+		return false;
+	}
+
+	if(! loadDL(handle, path, dl))
+	{
+		dlclose(handle);
+		linkerErrors = true;
+		return false;
+	}
+
+	return true;
+}
+
+void closeModule(struct DL *dl)
+{
+	if(dl->lazy)
+	{
+		munmap((void*)dl->file, dl->fileSize);
+		dl->lazy = false;
+	}
+	if(dl->handle == NULL)
+		return;
+
+	unloadProviders(dl);
+	dlclose(dl->handle);
+	dl->handle = NULL;
+	dl->provider = false;
+}
+
+/** Orders modules with recorded failures first, then by descending estimated duration */
+static int _cmp_module(const void *_l, const void *_r)
+{
+	const struct { struct DL *dl; bool failed; double estimate; } *l = _l, *r = _r;
+
+	if(l->failed != r->failed)
+		return r->failed - l->failed;
+
+	return (l->estimate < r->estimate) - (l->estimate > r->estimate);
+}
+
+size_t runModules(size_t count, struct DL *const _modules[static count])
+{
+	struct { struct DL *dl; bool failed; double estimate; } *order = malloc(count * sizeof(*order));
+	struct DL **modules = malloc(count * sizeof(struct DL*));
+	size_t loaded = 0;
+
+	if(count && (order == NULL || modules == NULL))
+	{
+		fprintf(stderr, RED_BOLD("Can't run tests") ": malloc() failed\n");
+		free(order);
+		free(modules);
+		return 1;
+	}
+
+	for(size_t i = 0; i < count; ++i)
+	{
+		struct DL *dl = _modules[i];
+		dl->variants = dl->succeeded = dl->failed = 0;
+		dl->duration = 0;
+
+		if((dl->handle || dl->lazy) && !dl->unaffected)
+		{
+			order[loaded].dl = dl;
+			order[loaded].failed = failuresRecorded(dl, NULL);
+			order[loaded++].estimate = historyEstimate(dl);
+		}
+	}
+
+	// longest processing time first, so that no long module starts last
+	qsort(order, loaded, sizeof(*order), _cmp_module);
+
+	for(size_t i = 0; i < loaded; ++i)
+		modules[i] = order[i].dl;
+
+	free(order);
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workerCount = cores > 0 ? (size_t)cores : 1;
+
+	if(workerCount > loaded)
+		workerCount = loaded;
+
+	struct ModuleQueue queue = { .modules = modules, .count = loaded };
+	pthread_t workers[workerCount];
+	size_t started = 0;
+	double start = now();
+	telemetryBegin(workerCount, loaded, modules);
+
+	while(started < workerCount)
+	{
+		int e = pthread_create(&workers[started], NULL, _runModuleQueue, &queue);
+
+		if(e)
+		{
+			fprintf(stderr, YELLOW("Running %zu %s in series due to pthread_create() error: %s\n"),
+				CONJUGATE(workerCount - started, "worker"), strerror(e));
+			break;
+		}
+
+		++started;
+	}
+
+	// runners start on tests whose providers are ready while the rest are generated
+	checkpointStart();
+	generateProviders();
+	checkpointProvidersDone();
+
+	if(started == 0)
+		_runModuleQueue(&queue);
+
+	for(size_t i = 0; i < started; ++i)
+	{
+		int e = pthread_join(workers[i], NULL);
+
+		if(e)
+			fprintf(stderr, YELLOW("Error joining worker thread: pthread_join(): %s\n"), strerror(e));
+	}
+
+	telemetryEnd();
+	checkpointStop();
+	double makespan = now() - start;
+	size_t totalSucceeded = 0, totalFailed = 0, totalVariants = 0;
+	double totalDuration = 0, longest = 0;
+
+	for(size_t i = 0; i < loaded; ++i)
+	{
+		struct DL *dl = modules[i];
+		totalSucceeded += dl->succeeded;
+		totalFailed += dl->failed;
+		totalVariants += dl->variants;
+		totalDuration += dl->duration;
+
+		if(dl->duration > longest)
+			longest = dl->duration;
+	}
+
+	free(modules);
+	failuresSave();
+
+	if(! options.replay)
+		historySave();
+
+	if(loaded > 1)
+	{
+		// no schedule on `threads` threads can finish before the longest module or the evenly split total
+		size_t threads = started ? started : 1;
+		double bound = totalDuration / threads > longest ? totalDuration / threads : longest;
+
+		printf("Makespan: %.3fs on %zu %s, lower bound %.3fs (%.0f%% efficiency)\n",
+			makespan, CONJUGATE(threads, "thread"), bound, makespan > 0 ? 100 * bound / makespan : 100.0);
+	}
+
+	profileReport();
+
+	size_t fuzzCrashes = options.fuzzDuration > 0 ? fuzzRun() : 0;
+	size_t poorScaling = options.stressThreads ? stressRun() : 0;
+
+	printf("Summary: Ran %zu %s from %zu %s with %zu %s,\x1B[%u;1m got %zu %s\x1B[0m\n",
+		CONJUGATE(totalSucceeded + totalFailed, "test"), CONJUGATE(loaded, "module"), CONJUGATE(totalVariants, "variant"),
+		totalFailed ? 31 : 92, CONJUGATE(totalFailed, "failure"));
+
+	return totalFailed + fuzzCrashes + poorScaling;
+}
+
+bool usesType(const struct DL *dl, const char *type)
+{
+	for(size_t i = 1; (dl->handle || dl->lazy) && i < dl->symbolCount; ++i)
+	{
+		const char *name = dl->strings + dl->symbols[i].st_name;
+		struct Signature sig;
+
+		if(strncmp(name, "_SIG_TEST_", 10) != 0 || !parseSignature(dl->elfOffset + dl->symbols[i].st_value, &sig))
+			continue;
+
+		for(unsigned int t = 0; t < sig.typeCount; ++t)
+		{
+			if(strcmp(sig.argTypes[t], type) == 0)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/** Prints usage information to stderr */
+void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options...] [subjects...] -- [providers/testers...]\n"
+		"Every argument is a shared object file.\n"
+		"'subjects' are the libraries being tested. Their symbols are exposed to the following testers.\n"
+		"The following objects expose providers which generate data sets, "
+			"and test cases which consume those values and check the interface exposed by subjects.\n"
+		"Options:\n"
+		"  --perf-counters=LIST  Measure hardware counters (e.g. cycles,instructions,cache-misses,branch-misses) per test\n"
+		"  --fuzz=DURATION       Fuzz tests with arguments for DURATION (e.g. 30s, 5m) after the regular run\n"
+		"  --fuzz-dir=DIR        Write crashing fuzzer inputs to DIR (default: ccheck-crashes)\n"
+		"  --watch               Stay resident and re-run the tests of objects whenever they are rebuilt\n"
+		"  --failure-db=FILE     Persist failing variants to FILE, to re-run them first next time\n"
+		"  --replay              Only run the failing variants recorded in the failure database\n"
+		"  --history=FILE        Record durations to FILE, to schedule long modules first next time\n"
+		"  --corpus=PATH         Provide every file in directory or packed corpus PATH as a CorpusEntry, may be repeated\n"
+		"  --async-limit=N       Run at most N variants of an ASYNC_TEST() concurrently (default: 64)\n"
+		"  --max-resident=N      Keep at most N test objects without providers loaded at once (default: no limit)\n"
+		"  --checkpoint=FILE     Write the progress of the run to FILE periodically, to continue with --resume if it is interrupted\n"
+		"  --checkpoint-interval=DURATION  Write checkpoints every DURATION (default: 1m)\n"
+		"  --resume=FILE         Continue the run whose checkpoint is FILE, and keep writing checkpoints to it\n"
+		"  --capture-output      Only print what a variant writes to stdout and stderr if it fails\n"
+		"  --dedup               Drop provided elements that are identical to another element of the same type\n"
+		"  --stress=THREADS      Run each THREADSAFE_TEST() on up to THREADS threads at once after the regular run and print how it scales\n"
+		"  --min-efficiency=PCT  Fail THREADSAFE_TEST()s whose parallel efficiency under --stress falls below PCT percent (default: 50)\n"
+		"  --pin                 Pin runner threads to cores and replicate provider data on every NUMA node\n"
+		"  --profile             Sample the stacks of runners and print the hottest functions of each test\n"
+		"  --flamegraph=FILE     Write the stacks sampled by --profile to FILE in collapsed format, implies --profile\n"
+		"  --affected-by=OLD     Only run test objects that import a subject symbol that changed since the build OLD\n"
+		"  --telemetry=SOCKET    Serve live progress as JSON to every connection on Unix domain socket SOCKET\n"
+		"  --compare OLD NEW     Run every variant against two builds of a subject and compare their speed and results\n"
+		"  -v, --verbose         Print additional diagnostics\n"
+		"  --help                Show this message\n", argv0);
+}
+
+/** Checks for an option that takes a value, given either as `--name=value` or as `--name value`
+	@param name The option name, including leading dashes
+	@param i The index of the current argument. Advanced past the value if it is given as a separate argument.
+	@param missing Set to true, with an error message printed, if the option is present but lacks a value
+	@returns The option's value, or NULL if `argv[*i]` is a different option or lacks a value
+ */
+const char *optionValue(const char *name, int argc, char **argv, int *i, bool *missing)
+{
+	size_t len = strlen(name);
+
+	if(strncmp(argv[*i], name, len) != 0)
+		return NULL;
+	if(argv[*i][len] == '=')
+		return argv[*i] + len + 1;
+	if(argv[*i][len] != 0)
+		return NULL;
+	if(*i + 1 >= argc)
+	{
+		fprintf(stderr, RED_BOLD("Missing value") " for option '%s'\n", name);
+		*missing = true;
+		return NULL;
+	}
+
+	return argv[++*i];
+}
+
+/** Parses a duration like "1.5", "300ms", "30s", "5m" or "2h"
+	@param out Receives the duration in seconds
+	@returns false and prints an error message if `str` is malformed
+ */
+bool parseDuration(const char *str, double *out)
+{
+	char *end;
+	double d = strtod(str, &end);
+
+	if(end == str || d < 0)
+		goto malformed;
+	else if(strcmp(end, "ms") == 0)
+		d /= 1000;
+	else if(strcmp(end, "m") == 0)
+		d *= 60;
+	else if(strcmp(end, "h") == 0)
+		d *= 60 * 60;
+	else if(*end && strcmp(end, "s") != 0)
+		goto malformed;
+
+	*out = d;
+	return true;
+
+	malformed:
+	fprintf(stderr, RED_BOLD("Invalid duration") " '%s'\n", str);
+	return false;
+}
+
+/** Parses every option in argv and removes them from it
+	@returns false and prints an error message on invalid options
+ */
+bool parseOptions(int *argc, char **argv)
+{
+	int n = 1;
+	bool missing = false;
+
+	#define OPTION(name) (val = optionValue(name, *argc, argv, &i, &missing))
+
+	for(int i = 1; i < *argc; ++i)
+	{
+		const char *arg = argv[i], *val;
+
+		if(strcmp(arg, "-v") == 0)
+		{
+			options.verbose = true;
+			continue;
+		}
+		if(strncmp(arg, "--", 2) != 0 || strcmp(arg, "--") == 0)
+		{
+			argv[n++] = argv[i];
+			continue;
+		}
+
+		if(strcmp(arg, "--help") == 0)
+			return false;
+		else if(OPTION("--perf-counters"))
+			options.perfCounters = val;
+		else if(OPTION("--fuzz"))
+		{
+			if(! parseDuration(val, &options.fuzzDuration))
+				return false;
+		}
+		else if(OPTION("--fuzz-dir"))
+			options.fuzzDir = val;
+		else if(strcmp(arg, "--watch") == 0)
+			options.watch = true;
+		else if(OPTION("--failure-db"))
+			options.failureDb = val;
+		else if(strcmp(arg, "--replay") == 0)
+			options.replay = true;
+		else if(strcmp(arg, "--compare") == 0)
+		{
+			if(i + 2 >= *argc)
+			{
+				fprintf(stderr, RED_BOLD("Missing value") " for option '--compare', which takes two subjects\n");
+				return false;
+			}
+
+			options.compareOld = argv[++i];
+			options.compareNew = argv[++i];
+		}
+		else if(OPTION("--history"))
+			options.historyFile = val;
+		else if(OPTION("--async-limit"))
+		{
+			char *end;
+			options.asyncLimit = strtoul(val, &end, 10);
+
+			if(end == val || *end || options.asyncLimit == 0)
+			{
+				fprintf(stderr, RED_BOLD("Invalid in-flight limit") " '%s'\n", val);
+				return false;
+			}
+		}
+		else if(OPTION("--max-resident"))
+		{
+			char *end;
+			options.maxResident = strtoul(val, &end, 10);
+
+			if(end == val || *end || options.maxResident == 0)
+			{
+				fprintf(stderr, RED_BOLD("Invalid resident limit") " '%s'\n", val);
+				return false;
+			}
+		}
+		else if(OPTION("--checkpoint"))
+			options.checkpoint = val;
+		else if(OPTION("--checkpoint-interval"))
+		{
+			if(! parseDuration(val, &options.checkpointInterval))
+				return false;
+		}
+		else if(OPTION("--resume"))
+		{
+			options.checkpoint = val;
+			options.resume = true;
+		}
+		else if(strcmp(arg, "--capture-output") == 0)
+			options.captureOutput = true;
+		else if(strcmp(arg, "--dedup") == 0)
+			options.dedup = true;
+		else if(OPTION("--stress"))
+		{
+			char *end;
+			options.stressThreads = strtoul(val, &end, 10);
+
+			if(end == val || *end || options.stressThreads == 0)
+			{
+				fprintf(stderr, RED_BOLD("Invalid thread count") " '%s'\n", val);
+				return false;
+			}
+		}
+		else if(OPTION("--min-efficiency"))
+		{
+			char *end;
+			options.stressEfficiency = strtod(val, &end);
+
+			if(end == val || *end || options.stressEfficiency < 0)
+			{
+				fprintf(stderr, RED_BOLD("Invalid efficiency") " '%s'\n", val);
+				return false;
+			}
+		}
+		else if(strcmp(arg, "--pin") == 0)
+			options.pin = true;
+		else if(strcmp(arg, "--profile") == 0)
+			options.profile = true;
+		else if(OPTION("--flamegraph"))
+		{
+			options.flamegraph = val;
+			options.profile = true;
+		}
+		else if(OPTION("--affected-by"))
+			options.affectedBy = val;
+		else if(OPTION("--telemetry"))
+			options.telemetry = val;
+		else if(OPTION("--corpus"))
+		{
+			const char **c = realloc(options.corpora, (options.corpusCount + 1) * sizeof(char*));
+
+			if(c == NULL)
+			{
+				fprintf(stderr, RED_BOLD("Out of memory") " while parsing options\n");
+				return false;
+			}
+
+			options.corpora = c;
+			options.corpora[options.corpusCount++] = val;
+		}
+		else if(strcmp(arg, "--verbose") == 0)
+			options.verbose = true;
+		else
+		{
+			if(missing)
+				return false;
+
+			fprintf(stderr, RED_BOLD("Unknown option") " '%s'\n", arg);
+			return false;
+		}
+	}
+
+	#undef OPTION
+
+	if(options.replay && options.failureDb == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Missing option") " '--failure-db', which '--replay' reads the failures from\n");
+		return false;
+	}
+
+	*argc = n;
+	return true;
+}
+
 int main(int argc, char **argv)
 {
-	if(argc == 0)
+	if(argc == 0 || !parseOptions(&argc, argv))
 	{
-		fprintf(stderr,
-			"Usage: %s [subjects...] -- [providers/testers...]\n"
-			"Every argument is a shared object file.\n"
-			"'subjects' are the libraries being tested. Their symbols are exposed to the following testers.\n"
-			"The following objects expose providers which generate data sets, "
-				"and test cases which consume those values and check the interface exposed by subjects.\n", argv[0]);
+		usage(argc ? argv[0] : "ccheck");
 		return 1;
 	}
+	if(options.perfCounters && !perfParse(options.perfCounters))
+		return 1;
 
-	size_t provCount = 0;
 	size_t subjectCount = 0;
-	void *subjects[argc];
-	struct DL _dls[argc];
-	dls = _dls;
+	void **subjects = NULL;
+	const char **subjectNames = NULL;
+	struct DL **modules = NULL;
 	bool gotSeparator = false;
 
 	srand(clock());
 
 	struct sigaction sa = {0};
 	sa.sa_handler = handleSignal;
+	// handleSignal() longjmp()s out, so the signal must not stay blocked.
+	// Threads that set up a signal stack, like those running ASYNC_TEST()s, handle stack overflows on it.
+	sa.sa_flags = SA_NODEFER | SA_ONSTACK;
 	sigemptyset(&sa.sa_mask);
-	sigaddset(&sa.sa_mask, SA_NODEFER);
 	#define SIGACTION(no, desc) do { \
 		if(sigaction(no, &sa, NULL)) \
 			fprintf(stderr, YELLOW("%s will not be caught due to sigaction() error: %s\n"), desc, strerror(errno)); \
@@ -838,6 +1977,32 @@ int main(int argc, char **argv)
 
 	#undef SIGACTION
 
+	if(options.compareOld)
+		return compareBuilds(argc - 1, argv + 1);
+
+	// on the heap, since suites may consist of thousands of objects
+	subjects = malloc(argc * sizeof(void*));
+	subjectNames = malloc(argc * sizeof(char*));
+	dls = malloc(argc * sizeof(struct DL));
+	modules = malloc(argc * sizeof(struct DL*));
+
+	if(!subjects || !subjectNames || !dls || !modules)
+	{
+		fprintf(stderr, RED_BOLD("Out of memory") " while loading objects\n");
+		return 1;
+	}
+
+	if(options.telemetry && !telemetryStart())
+		return 1;
+	if(options.pin && !numaInit())
+		return 1;
+	if(options.profile && !profileStart())
+		return 1;
+
+	// objects without providers are only opened while their tests run, except when their handles need to persist
+	bool lazy = !options.watch && options.fuzzDuration == 0 && options.stressThreads == 0;
+	size_t lazyCount = 0;
+
 	// load DLs and providers
 	for(int i = 1; i < argc; ++i)
 	{
@@ -847,86 +2012,81 @@ int main(int argc, char **argv)
 			continue;
 		}
 
-		void *handle = dlopen(argv[i], RTLD_NOW | (gotSeparator ? RTLD_LOCAL : RTLD_GLOBAL));
-
-		if(handle == NULL)
-		{
-			fprintf(stderr, RED_BOLD("Error loading")" '%s': %s\n", argv[i], dlerror());
-			linkerErrors = true;
-			continue;
-		}
-
 		// subjects are only loaded for the side effects from dlopen()
 		if(! gotSeparator)
 		{
-			subjects[subjectCount++] = handle;
-			continue;
-		}
+			void *handle = openSubject(argv[i]);
+
+			if(handle)
+			{
+				subjectNames[subjectCount] = argv[i];
+				subjects[subjectCount++] = handle;
+			}
 
-		if(! loadDL(handle, argv[i]))
-		{
-			dlclose(handle);
-			linkerErrors = true;
 			continue;
 		}
 
-		provCount += loadProviders(&dls[dlCount - 1]);
+		if(lazy && scanModule(argv[i], &dls[dlCount]))
+			++lazyCount;
+		else
+			openModule(argv[i], &dls[dlCount]);
+
+		++dlCount;
 	}
 
-	printf("Loaded %zu %s and %zu %s.\n", CONJUGATE(subjectCount, "subject"), CONJUGATE(provCount, "provider"));
+	size_t loaded = 0;
 
 	for(size_t i = 0; i < dlCount; ++i)
-	{
-		int e = pthread_create( &dls[i].runner, NULL, _runTests, &dls[i] );
+		loaded += dls[i].handle || dls[i].lazy;
 
-		if(!(dls[i].parallel = !e))
-			fprintf(stderr, YELLOW("Running '%s' in series due to pthread_create() error: %s\n"), dls[i].name, strerror(e));
-	}
+	for(size_t i = 0; i < options.corpusCount; ++i)
+		linkerErrors |= !corpusLoad(options.corpora[i]);
 
-	for(size_t i = 0; i < dlCount; ++i)
-	{
-		if(!dls[i].parallel)
-			runTests(&dls[i]);
-	}
+	printf("Loaded %zu %s and %zu %s", CONJUGATE(subjectCount, "subject"), CONJUGATE(loaded, "test object"));
 
-	size_t totalSucceeded = 0, totalFailed = 0, totalVariants = 0;
+	if(lazyCount)
+		printf(", %zu of which %s opened on demand", lazyCount, lazyCount != 1 ? "are" : "is");
 
-	for(size_t i = 0; i < dlCount; ++i)
-	{
-		if(dls[i].parallel)
-		{
-			int e = pthread_join(dls[i].runner, NULL);
+	puts(".");
 
-			if(e)
-				fprintf(stderr, YELLOW("Error joining thread of '%s': pthread_join(): %s\n"), dls[i].name, strerror(e));
-		}
+	if(options.affectedBy && !affectedSelect(subjectCount, subjects))
+		return 1;
 
-		totalSucceeded += dls[i].succeeded;
-		totalFailed += dls[i].failed;
-		totalVariants += dls[i].variants;
-	}
+	planProviders();
 
-	printf("Summary: Ran %zu %s from %zu %s with %zu %s,\x1B[%u;1m got %zu %s\x1B[0m\n",
-		CONJUGATE(totalSucceeded + totalFailed, "test"), CONJUGATE(dlCount, "module"), CONJUGATE(totalVariants, "variant"),
-		totalFailed ? 31 : 92, CONJUGATE(totalFailed, "failure"));
+	size_t recorded = failuresLoad();
+	historyLoad();
+
+	if(options.resume && !checkpointLoad())
+		return 1;
+
+	if(options.replay)
+		printf("Replaying %zu recorded %s.\n", CONJUGATE(recorded, "failure"));
+
+	for(size_t i = 0; i < dlCount; ++i)
+		modules[i] = &dls[i];
+
+	size_t failures = runModules(dlCount, modules);
+
+	if(options.watch)
+		watch(subjectCount, subjects, subjectNames);
 
 	if(linkerErrors)
 		puts(RED("There were linking errors"));
 
+	for(size_t i = 0; i < dlCount; ++i)
+		closeModule(&dls[i]);
 	for(size_t i = 0; i < subjectCount; ++i)
 		dlclose(subjects[i]);
-	for(size_t i = 0; i < dlCount; ++i)
-		dlclose(dls[i].handle);
-	for(struct ProviderBucket *b = providerRoot; b;)
-	{
-		for (size_t i = 0; i < b->count; ++i)
-			free((void*) b->providers[i].data);
 
-		struct ProviderBucket *next = b->next;
-		free(b->providers);
-		free(b);
-		b = next;
-	}
+	telemetryStop();
+	numaCleanup();
+	corpusUnload();
+	free(options.corpora);
+	free(modules);
+	free(dls);
+	free(subjectNames);
+	free(subjects);
 
-	return linkerErrors || totalFailed > 0;
+	return linkerErrors || failures > 0;
 }
\ No newline at end of file
@@ -0,0 +1,876 @@
+/* Internal declarations shared between the translation units of the ccheck executable.
+	Test code should only ever include interface.h
+*/
+#pragma once
+#define _GNU_SOURCE
+
+#include <elf.h>
+#include <link.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "interface.h"
+
+#define RED_BOLD(msg) "\x1B[31;1m" msg "\x1B[0m"
+#define RED(msg) "\x1B[31m" msg "\x1B[0m"
+#define YELLOW(msg) "\x1B[33m" msg "\x1B[0m"
+
+/** Conjugates an irregular noun so that is matches the number n.
+	@param n The number of items to conjugate for. Evaluated twice.
+	@param x The singular form
+	@param xs The plural form
+	@returns inputs to a printf format like "%d %s"
+ */
+#define CONJUGATE3(n, x, xs) (n) , ((n) != 1 ? (xs) : (x))
+
+/** Conjugates a noun so that it matches the number n.
+	@warning Assumes a regular noun so it only adds "s"
+	@returns inputs to a printf format like "%d %s"
+*/
+#define CONJUGATE(n, x) CONJUGATE3(n, x, x "s")
+
+struct ProviderBucket;
+
+/** The location of a provider that a DERIVED_PROVIDER() takes elements from */
+struct ProviderSource
+{
+	struct ProviderBucket *bucket;
+	/** The index of the provider within `bucket`, updated by deriveRelink() */
+	size_t index;
+	/** The object and name of the provider, to locate it again */
+	const char *dlName, *name;
+};
+
+/** A set of typed data to be fed into tests */
+struct Provider
+{
+	/** Name of the dynamic object providing this dataset */
+	const char *dlName;
+	/** Human readable name for this data-set.
+		Determined by the second argument to the PROVIDER() macro
+	 */
+	const char *name;
+	/** Number of items in this dataset */
+	size_t count;
+	/** Actual dataset */
+	const void *data;
+	/** Formatting function */
+	format_f format;
+	/** [0 ; numaNodes) -> a copy of `data` on that NUMA node, or NULL if it isn't replicated. See numaReplicate(). */
+	const void **replicas;
+	/** The description of a derived provider, whose elements are computed by deriveArg(), or NULL.
+		`data` is then NULL, or the list of indices kept by a filter.
+	 */
+	const struct DerivedProvider *derived;
+	/** [0 ; sourceCount) -> the providers a derived provider takes elements from, malloc()ed */
+	struct ProviderSource *sources;
+	size_t sourceCount;
+	/** The number of elements dropped from `data` by dedupBucket() */
+	size_t duplicates;
+};
+
+/** An collection of data sets for test parameters. Forms a single-linked list. */
+struct ProviderBucket
+{
+	/** The type name of the data, as given to the PROVIDER() macro */
+	const char *type;
+	/** The size of each individual element, determined automatically via sizeof().
+		Sanity-checked between different providers.
+	 */
+	size_t elementSize;
+	/** Every data set available for this type */
+	struct Provider *providers;
+	/** The length of providers */
+	size_t count;
+	/** The next bucket for a different type. */
+	struct ProviderBucket *next;
+	/** The number of providers that still have to generate data for this bucket */
+	size_t pending;
+	/** Whether every provider finished, so that tests may use this bucket. Guarded by `providerLock`. */
+	bool complete;
+};
+
+/** Information on a dynamically linked object supplied as CLI argument */
+struct DL
+{
+	/** The handle returned by dlopen() */
+	void *handle;
+	/** The start of the mapped memory at ELF offset 0 */
+	const char *elfOffset;
+	/** The number of entries in symbols */
+	size_t symbolCount;
+	/** The symbol table */
+	const ElfW(Sym) *symbols;
+	/** The string table */
+	const char *strings;
+
+	/** The path used as CLI argument */
+	const char *name;
+	/** The time in seconds spent running this object's tests */
+	double duration;
+	/** Whether this object contained one or more providers. */
+	bool provider;
+	/** Whether this object is only opened while its tests run, see scanModule().
+		Its symbol and string tables then point into `file` rather than the loaded object.
+	 */
+	bool lazy;
+	/** The read-only mapping of a lazy object's file */
+	const void *file;
+	/** The length of `file` */
+	size_t fileSize;
+	/** Whether this object imports none of the symbols changed since `options.affectedBy`, so that its tests are skipped */
+	bool unaffected;
+
+	/** The total number of times test functions from this object were called */
+	size_t variants;
+	/** The number of individual tests that succeeded
+		@note This number is tests, not test function calls / variants.
+	*/
+	size_t succeeded;
+	/** The number of individual tests that failed */
+	size_t failed;
+};
+
+typedef void (*test_f)();
+
+/** The parsed signature of a TEST() function, as encoded in its _SIG_TEST_* symbol */
+struct Signature
+{
+	/** The number of function arguments */
+	unsigned int arity;
+	/** The number of unique types in the arguments, <= arity */
+	unsigned int typeCount;
+	/** [0 ; typeCount) -> type names */
+	const char *argTypes[MAX_ARITY];
+	/** [0 ; arity) -> [0 ; typeCount) */
+	int argTypeIndices[MAX_ARITY];
+	/** [0 ; arity) -> argument names */
+	const char *argNames[MAX_ARITY];
+};
+
+/** A TEST() function located in a dynamic object */
+struct Test
+{
+	/** The name given to TEST(), pointing into the object's string table */
+	const char *name;
+	/** The wrapper generated by TEST(), accepting pointers to each argument */
+	test_f func;
+	/** The test's arguments */
+	struct Signature sig;
+	/** Whether it was declared with ASYNC_TEST() */
+	bool async;
+	/** Whether it was declared with THREADSAFE_TEST() */
+	bool threadsafe;
+	/** The name of the fixture given to TEST_WITH(), or NULL */
+	const char *fixture;
+};
+
+/** Maximum length of message on test failure. */
+#define TEST_MESSAGE_SIZE 200
+
+/** Output of a variant to stdout or stderr, kept under `--capture-output` */
+struct Capture
+{
+	/** malloc()ed, not null-terminated */
+	char *data;
+	size_t length, cap;
+	/** The number of bytes that didn't fit */
+	size_t dropped;
+};
+
+/** Information on the currently running test */
+struct TestState
+{
+	/** Whether `failTarget` is currently in a valid state */
+	bool jumpReady;
+	/** Whether `successTarget` is currently in a valid state */
+	bool successJumpReady;
+	/** a longjmp() target to continue at on test failure */
+	jmp_buf failTarget;
+	/** a longjmp() target to continue at on test success */
+	jmp_buf successTarget;
+	/** Stores a custom message to display in addition to the failed test's invocation */
+	char message[TEST_MESSAGE_SIZE];
+	/** size of `exitMask` */
+	unsigned exitMaskSize;
+	/** malloc()ed pointer to a list of exit codes */
+	int *exitMask;
+	/** Whether writes to stdout and stderr currently go to `capture` */
+	bool capturing;
+	/** The output of the current or last variant, or NULL if none was captured yet */
+	struct Capture *capture;
+	/** The fixture of the running test, or NULL */
+	struct FixtureInstance *fixture;
+};
+
+extern __thread struct TestState runningTest;
+
+/** Settings given via command line flags */
+struct Options
+{
+	/** Comma-separated list of hardware counters given to `--perf-counters`, or NULL */
+	const char *perfCounters;
+	/** Time in seconds to spend fuzzing after the regular run, or 0 */
+	double fuzzDuration;
+	/** Directory that crashing fuzzer inputs are written to */
+	const char *fuzzDir;
+	/** Keep running and re-run tests whenever an object changes */
+	bool watch;
+	/** The file that failing variants are persisted to between runs */
+	const char *failureDb;
+	/** Only run the variants recorded in `failureDb` */
+	bool replay;
+	/** The file that durations of modules and tests are persisted to between runs */
+	const char *historyFile;
+	/** malloc()ed list of every directory or packed file given to `--corpus` */
+	const char **corpora;
+	/** The length of `corpora` */
+	size_t corpusCount;
+	/** The maximum number of variants of an ASYNC_TEST() in flight at once */
+	size_t asyncLimit;
+	/** The maximum number of test objects without providers opened at once, or 0 for no limit */
+	size_t maxResident;
+	/** The maximum number of threads to run each THREADSAFE_TEST() on after the regular run, or 0 */
+	size_t stressThreads;
+	/** The parallel efficiency in percent below which a THREADSAFE_TEST() fails under `--stress`, as given to `--min-efficiency` */
+	double stressEfficiency;
+	/** Pin runner threads to cores and replicate provider data per NUMA node */
+	bool pin;
+	/** Sample the stacks of runners and print the hottest functions of each test */
+	bool profile;
+	/** The file to write the collapsed stacks sampled by `--profile` to, or NULL */
+	const char *flamegraph;
+	/** The file progress is periodically written to, or NULL */
+	const char *checkpoint;
+	/** Seconds between two checkpoints */
+	double checkpointInterval;
+	/** Continue from the progress in `checkpoint` */
+	bool resume;
+	/** Drop elements that are identical to another element of their bucket */
+	bool dedup;
+	/** The Unix domain socket to serve progress on, or NULL */
+	const char *telemetry;
+	/** A previous build of a subject, whose changes select the test objects to run, or NULL */
+	const char *affectedBy;
+	/** The two subject builds given to `--compare`, or NULL */
+	const char *compareOld, *compareNew;
+	/** Keep the output of every variant in memory and only print it if the variant fails */
+	bool captureOutput;
+	/** Print additional diagnostics */
+	bool verbose;
+};
+
+extern struct Options options;
+
+
+/* ccheck.c */
+
+/** Set whenever an object or provider failed to load */
+extern bool linkerErrors;
+/** The first bucket of the list of every loaded provider */
+extern struct ProviderBucket *providerRoot;
+/** Every test object given after `--` */
+extern struct DL *dls;
+/** The length of `dls` */
+extern size_t dlCount;
+/** When a provider does not give a number of data points, use this instead. */
+extern const size_t FALLBACK_VARIANT_COUNT;
+
+/** @returns The current CLOCK_MONOTONIC time in seconds */
+double now(void);
+
+/** Like testFailure(), but taking a va_list */
+__attribute__((noreturn))
+void testFailureV(const char *fmt, va_list ls);
+
+/** Locates a provider for the given type name */
+struct ProviderBucket *findProvider(const char *type);
+
+/** A unit of scratch memory, aligned suitably for any provided type */
+typedef union { long double ld; long long ll; void *ptr; void (*func)(void); } scratch_t;
+
+/** The number of `scratch_t` needed to hold `size` bytes */
+#define SCRATCH_WORDS(size) (((size) + sizeof(scratch_t) - 1) / sizeof(scratch_t))
+
+/**
+	@param bucket The bucket to grab the test data from
+	@param providerIndex which provider to use from that bucket
+	@param dataPosition which item to use from that provider
+	@param scratch Receives elements of derived providers that aren't stored anywhere.
+		Holds at least `bucket->elementSize` bytes, aligned like `scratch_t`. See scratchWords().
+	@returns A pointer to the test data at the provided indices, which may be `scratch`
+*/
+const void *locateArg(struct ProviderBucket *bucket, size_t providerIndex, size_t dataPosition, void *scratch);
+
+/** Whether the elements of a provider may hold pointers, which are only valid in this process and can't be mutated byte-wise.
+	ccheck doesn't know the layout of provided types, so a type whose name contains '*' holds pointers,
+	and so does any element with an aligned word that points into mapped memory. Derived providers are judged by their first elements.
+	If the mapped memory can't be determined, every provider is assumed to hold pointers.
+ */
+bool holdsPointers(struct ProviderBucket *b, size_t providerIndex);
+
+/** Adds a provider to the bucket for its type, creating the bucket if needed
+	@param size The size of each element in `p->data`
+	@returns false and prints an error message on failure
+ */
+bool registerProvider(const char *type, size_t size, const struct Provider *p);
+
+/** Parses the signature string emitted by TEST()
+	@param str The value of a _SIG_TEST_* symbol
+	@returns false if the test has more than MAX_ARITY arguments
+ */
+bool parseSignature(const char *str, struct Signature *sig);
+
+/** Calls a test function
+	@param args [0 ; arity) -> pointers to the argument values
+ */
+void invokeTest(test_f func, unsigned int arity, const void *const args[]);
+
+/** Runs a single variant of a test, catching failures
+	@param args [0 ; arity) -> pointers to the argument values
+	@returns true if the test succeeded
+	@returns false if it failed, with the reason stored in `runningTest.message`
+ */
+bool runVariant(test_f func, unsigned int arity, const void *const args[]);
+
+/** Prints the report for a failed variant, including the reason stored in `runningTest.message`
+	@param formats [0 ; arity) -> formatting function for each argument
+	@param args [0 ; arity) -> the argument values
+	@param origins [0 ; arity) -> a description of where each argument came from
+ */
+void printFailure(const struct DL *dl, const struct Test *test, const format_f formats[], const void *const args[], const char *const origins[]);
+
+/** Enumerates all vectors { v ∈ ℕⁿ. 0 ≤ vᵢ < ms[i] }
+	@returns false When all values have been visited
+ */
+bool nextCombination(size_t n, const size_t ms[static n], size_t result[static n]);
+
+/** Counts the variants of a test with the given signature, as runSingleTest() enumerates them.
+	Providers that are still pending are assumed to produce FALLBACK_VARIANT_COUNT elements.
+	Must be called with `providerLock` held while providers are generated.
+	@param duplicates Whether to include the elements dropped by `--dedup`
+ */
+size_t countVariants(const struct Signature *sig, bool duplicates);
+
+/** Runs every variant of a test and updates the counters in `dl`
+	@returns true if the test succeeded
+ */
+bool runSingleTest(struct DL *dl, const struct Test *test);
+
+/** Collects every test in a dynamic object, ordering tests that failed in a previous run first
+	@param tests Receives a malloc()ed list of tests
+	@returns The length of `tests`
+ */
+size_t collectTests(struct DL *dl, struct Test **tests);
+
+/** Initializes a DL reference
+	@param handle A non-null pointer returned by dlopen() or dlmopen()
+	@param name A name identifying that dynamic object
+	@param out Receives the DL reference
+	@returns false and prints an error message on failure
+ */
+bool loadDL(void *handle, const char *name, struct DL *out);
+
+/** Like loadDL(), but for any loaded object, leaving `handle` NULL
+	@param lm The object's entry in the link map
+ */
+bool loadLinkMap(const struct link_map *lm, const char *name, struct DL *out);
+
+/** Opens a subject, exposing its symbols to every object loaded afterwards
+	@returns The handle returned by dlopen(), or NULL after printing an error message
+ */
+void *openSubject(const char *path);
+
+/** Opens a test object. Its providers are scheduled separately by planProviders().
+	@param dl Receives the loaded object. Its `handle` is NULL if loading failed.
+	@returns false and prints an error message on failure
+ */
+bool openModule(const char *path, struct DL *dl);
+
+/** Guards the `pending` and `complete` fields of every ProviderBucket */
+extern pthread_mutex_t providerLock;
+/** Signaled whenever a ProviderBucket completes */
+extern pthread_cond_t providerReady;
+
+/** Scans the signatures of every test in `dls` and schedules exactly those providers that produce a type some test uses.
+	Their buckets are created right away and marked incomplete.
+	Providers that are already loaded are kept.
+ */
+void planProviders(void);
+
+/** Runs every provider scheduled by planProviders(), completing buckets as soon as all their providers are done */
+void generateProviders(void);
+
+/** Unloads a test object opened with openModule() or scanned with scanModule(), including its providers */
+void closeModule(struct DL *dl);
+
+/** Removes every provider loaded from the given object */
+void unloadProviders(const struct DL *dl);
+
+/** Runs the tests of several objects on a pool of worker threads, while generating the data of providers scheduled by planProviders(),
+	and prints a summary. Objects that failed to load are skipped.
+	Objects with recorded failures start first, then the others by their estimated duration, longest first.
+	@returns The number of failures
+ */
+size_t runModules(size_t count, struct DL *const modules[static count]);
+
+/** @returns Whether any test in `dl` takes an argument of the given type */
+bool usesType(const struct DL *dl, const char *type);
+
+
+/* perf.c */
+
+/** The maximum number of hardware counters that can be requested at once */
+#define MAX_PERF_COUNTERS 8
+
+/** Whether the calling thread currently has a usable counter group */
+extern __thread bool perfActive;
+
+/** Parses the argument to `--perf-counters`
+	@param spec A comma-separated list of counter names
+	@returns false and prints an error message on failure
+ */
+bool perfParse(const char *spec);
+
+/** Opens the counter group for the calling thread, if counters were requested.
+	Disables counters for the thread and prints a warning (once) if that fails.
+ */
+void perfThreadInit(void);
+
+/** Closes the counter group of the calling thread */
+void perfThreadClose(void);
+
+/** Zeroes the counters of the calling thread */
+void perfReset(void);
+
+/** Starts counting on the calling thread. Only call when `perfActive`. */
+void perfStart(void);
+
+/** Stops counting on the calling thread. Only call when `perfActive`. */
+void perfStop(void);
+
+/** Prints per-variant averages of the calling thread's counters since the last `perfReset()`
+	@param variants The number of variants executed since the last reset
+ */
+void perfReport(const struct DL *dl, const char *testName, size_t variants);
+
+
+/* fuzz.c */
+
+/** Registers a test that passed its regular run for fuzzing.
+	Thread-safe, may be called from any runner.
+ */
+void fuzzAddTarget(struct DL *dl, const struct Test *test);
+
+/** Fuzzes every registered target on all cores for `options.fuzzDuration` seconds
+	@returns The number of targets a crashing input was found for
+ */
+size_t fuzzRun(void);
+
+
+/* replay.c */
+
+/** Reads the failures recorded by previous runs from `options.failureDb`, if it exists
+	@returns The number of recorded failures
+ */
+size_t failuresLoad(void);
+
+/** @param testName The name of a test, or NULL to check for any test in `dl`
+	@returns Whether a failure of that test was recorded by a previous run
+ */
+bool failuresRecorded(const struct DL *dl, const char *testName);
+
+/** Runs the variants of a test that failed in a previous run, updating the counters in `dl`.
+	Stops at the first one that still fails, after printing and recording it.
+	@returns false if a recorded variant still failed
+ */
+bool failuresReplay(struct DL *dl, const struct Test *test);
+
+/** Records a failed variant. Thread-safe, may be called from any runner.
+	@param providers [0 ; arity) -> the provider each argument was taken from
+	@param indices [0 ; arity) -> the index of each argument within its provider
+ */
+void failuresRecord(const struct DL *dl, const struct Test *test, const struct Provider *const providers[], const size_t indices[]);
+
+/** Replaces `options.failureDb` with the failures recorded during this run,
+	plus the previously recorded failures of tests that didn't run again.
+ */
+void failuresSave(void);
+
+
+/* history.c */
+
+/** Reads the durations recorded by previous runs from `options.historyFile`, if it exists */
+void historyLoad(void);
+
+/** Estimates the time in seconds needed to run the tests of an object.
+	Tests without recorded durations are estimated from the number of variants their providers are going to produce.
+ */
+double historyEstimate(const struct DL *dl);
+
+/** Records the duration of a test. Thread-safe, may be called from any runner. */
+void historyRecordTest(const struct DL *dl, const char *testName, size_t variants, double seconds);
+
+/** Records the `duration` of an object. Thread-safe, may be called from any runner. */
+void historyRecordModule(const struct DL *dl);
+
+/** Writes every recorded duration to `options.historyFile` */
+void historySave(void);
+
+
+/* corpus.c */
+
+/** Maps every file in a corpus directory, or every entry of a packed corpus file, and registers them as a provider of `CorpusEntry`.
+	Any other file is provided as a single entry.
+	@returns false and prints an error message on failure
+ */
+bool corpusLoad(const char *path);
+
+/** The formatting function for `CorpusEntry`, printing the entry's name and length */
+size_t formatCorpusEntry(char *to, size_t n, const CorpusEntry *e);
+
+/** Unmaps every corpus. Corpus providers must not be used afterwards. */
+void corpusUnload(void);
+
+
+/* async.c */
+
+/** Runs every variant of an ASYNC_TEST(), up to `options.asyncLimit` of them concurrently on the calling thread,
+	and updates the counters in `dl`
+	@returns true if the test succeeded
+ */
+bool runAsyncTest(struct DL *dl, const struct Test *test);
+
+
+/* compare.c */
+
+/** The functions of ccheck that ccheck-shim.so forwards calls to.
+	Objects in the link-map namespaces created by `--compare` can't see the symbols exported by the ccheck executable.
+ */
+struct ShimHooks
+{
+	void (*testFailureV)(const char *fmt, va_list ls);
+	void (*testSuccess)(void);
+	void (*expectExit)(unsigned count, const int codes[]);
+	void (*undoExpectExit)(void);
+	void (*exit)(int status);
+	void (*assertFail)(const char *assertion, const char *file, unsigned int line, const char *func);
+	ssize_t (*asyncRead)(int fd, void *buf, size_t n, off_t offset);
+	ssize_t (*asyncWrite)(int fd, const void *buf, size_t n, off_t offset);
+	void (*asyncYield)(void);
+	void *(*testFixture)(void);
+};
+
+/** Loads `options.compareOld` and `options.compareNew` into separate namespaces, along with a copy of every test object each,
+	and runs every variant against both builds, interleaved on the calling thread.
+	Prints the relative speed of each test and every variant whose result differs between the builds.
+	@param argc The number of arguments after the options
+	@param argv The arguments after the options, which must start with `--`
+	@returns The exit code for ccheck
+ */
+int compareBuilds(int argc, char **argv);
+
+
+/* lazy.c */
+
+/** Reads the symbol table of a test object from its file without opening it, so that it can be opened on demand by openLazy().
+	@param dl Receives the lazy object
+	@returns false if the object contains providers or can't be scanned, and must be opened with openModule() instead
+ */
+bool scanModule(const char *path, struct DL *dl);
+
+/** Opens a lazy object to run its tests, waiting while `options.maxResident` lazy objects are open
+	@returns false and prints an error message on failure
+ */
+bool openLazy(struct DL *dl);
+
+/** Closes a lazy object opened by openLazy(), keeping the tables read by scanModule() */
+void closeLazy(struct DL *dl);
+
+
+/* telemetry.c */
+
+/** The length of the test name stored in a TelemetrySlot, including the terminator */
+#define SLOT_NAME_SIZE 240
+
+/** The progress of one worker thread, as served by `--telemetry` */
+struct TelemetrySlot
+{
+	/** The number of variants the worker ran during this run. Only ever written by the worker itself. */
+	size_t variants;
+	/** A sequence lock around `test`, which is odd while the worker writes it */
+	size_t seq;
+	/** "module::test" of the test currently running, or empty while idle */
+	char test[SLOT_NAME_SIZE];
+};
+
+/** The slot of the calling worker, or NULL if telemetry is off */
+extern __thread struct TelemetrySlot *telemetrySlot;
+
+/** Counts a variant run by the calling thread.
+	Since only the owning thread writes its slot, this is a plain load and store rather than a locked instruction.
+ */
+static inline void telemetryVariant(void)
+{
+	struct TelemetrySlot *s = telemetrySlot;
+
+	if(s)
+		__atomic_store_n(&s->variants, __atomic_load_n(&s->variants, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/** Starts serving telemetry on `options.telemetry` from a separate thread
+	@returns false and prints an error message on failure
+ */
+bool telemetryStart(void);
+
+/** Resets the counters for a run of the given modules on `threads` workers */
+void telemetryBegin(size_t threads, size_t count, struct DL *const modules[static count]);
+
+/** Marks the current run as finished */
+void telemetryEnd(void);
+
+/** Assigns a slot to the calling worker
+	@param index The worker's index in [0 ; threads) as given to telemetryBegin()
+ */
+void telemetryThreadInit(size_t index);
+
+/** Releases the calling worker's slot */
+void telemetryThreadClose(void);
+
+/** Publishes the test the calling worker is about to run */
+void telemetryTestStart(const struct DL *dl, const struct Test *test);
+
+/** Counts the test the calling worker finished */
+void telemetryTestEnd(bool succeeded);
+
+/** Stops serving telemetry and removes the socket */
+void telemetryStop(void);
+
+
+/* dedup.c */
+
+/** Drops elements of a completed bucket that are byte-wise identical to earlier elements of any of its providers, if `options.dedup` is set.
+	Derived providers and their sources are left as they are, and every provider keeps at least one element.
+ */
+void dedupBucket(struct ProviderBucket *b);
+
+/** @returns The number of variants of a test that dedupBucket() removed */
+size_t dedupSaved(const struct Test *test);
+
+
+/* stress.c */
+
+/** Registers a THREADSAFE_TEST() that passed its regular run for `--stress`.
+	Thread-safe, may be called from any runner.
+ */
+void stressAddTarget(struct DL *dl, const struct Test *test);
+
+/** Runs every registered target on 1, 2, 4 … `options.stressThreads` threads and prints its throughput at each step
+	@returns The number of targets that failed, or whose efficiency fell below `options.stressEfficiency`
+ */
+size_t stressRun(void);
+
+
+/* checkpoint.c */
+
+/** Incremented whenever a checkpoint was written, asking runners to publish their progress */
+extern size_t checkpointEpoch;
+/** The value of `checkpointEpoch` that the calling runner last published its progress for */
+extern __thread size_t checkpointSeen;
+
+/** Reads the checkpoint given to `--resume` and the provider data saved with it
+	@returns false and prints an error message if it is malformed
+ */
+bool checkpointLoad(void);
+
+/** Takes the data of a provider saved with the resumed checkpoint
+	@param count Receives the number of elements
+	@returns The malloc()ed data, owned by the caller, or NULL if none was saved
+ */
+void *checkpointTakeProvider(const char *dlName, const char *name, size_t size, size_t *count);
+
+/** Starts writing checkpoints every `options.checkpointInterval` seconds, if `options.checkpoint` is set */
+void checkpointStart(void);
+
+/** Saves the generated provider data next to the checkpoint, after which checkpoints are written */
+void checkpointProvidersDone(void);
+
+/** Stops writing checkpoints and removes the checkpoint, since the run finished */
+void checkpointStop(void);
+
+/** Accounts for a test that finished before the resumed checkpoint was written
+	@returns true if the test should be skipped
+ */
+bool checkpointSkip(struct DL *dl, const struct Test *test);
+
+/** Publishes that the calling runner starts a test, continuing where the resumed checkpoint left it
+	@param buckets [0 ; typeCount) -> the bucket of each of the test's types
+	@param providers Receives the provider selected for each type, if the test is resumed
+	@param indices Receives the data index of each argument, if the test is resumed
+	@returns The number of variants run before the checkpoint, or 0 if the test starts from the beginning
+ */
+size_t checkpointTestStart(const struct DL *dl, const struct Test *test, struct ProviderBucket *const buckets[], size_t providers[static MAX_ARITY], size_t indices[static MAX_ARITY]);
+
+/** Publishes the position of the calling runner in its test's variants. See checkpointVariant(). */
+void checkpointPublish(size_t variants, const size_t providers[static MAX_ARITY], const size_t indices[static MAX_ARITY]);
+
+/** Publishes the position of the calling runner once per checkpoint, which costs a single load per variant in between
+	@param variants The number of variants run so far
+	@param providers The provider selected for each type
+	@param indices The data index of each argument of the next variant
+ */
+static inline void checkpointVariant(size_t variants, const size_t providers[static MAX_ARITY], const size_t indices[static MAX_ARITY])
+{
+	if(__atomic_load_n(&checkpointEpoch, __ATOMIC_RELAXED) != checkpointSeen)
+		checkpointPublish(variants, providers, indices);
+}
+
+/** Records that a test finished */
+void checkpointTestEnd(const struct DL *dl, const struct Test *test, bool passed, size_t variants);
+
+
+/* affected.c */
+
+/** Compares the subject sharing its file name with `options.affectedBy`, or the only subject, with that previous build,
+	and marks every test object that imports none of the changed symbols as unaffected.
+	If a symbol that isn't exported changed, every object stays affected.
+	@param subjects [0 ; subjectCount) -> subject handles
+	@returns false and prints an error message if the builds can't be compared
+ */
+bool affectedSelect(size_t subjectCount, void *const subjects[static subjectCount]);
+
+
+/* output.c */
+
+/** Starts capturing the output of a variant in `runningTest.capture`, discarding that of the previous one, if `options.captureOutput` is set.
+	Uses a buffer of the calling thread unless the test state brings its own.
+ */
+void captureBegin(void);
+
+/** Stops capturing, keeping the output for capturePrint() */
+void captureEnd(void);
+
+/** Prints the output captured from the last variant to stdout, if there is any */
+void capturePrint(void);
+
+/** Releases a capture buffer */
+void captureFree(struct Capture *c);
+
+/** Releases the capture buffer of the calling thread */
+void captureThreadClose(void);
+
+
+/* fixture.c */
+
+/** Sets up the fixture of a test for the calling thread, unless it already has one that no failing variant broke, and makes it current
+	@returns false and prints an error message if the setup failed, which fails the test
+ */
+bool fixtureEnter(const struct DL *dl, const struct Test *test);
+
+/** Resets the current fixture before a variant, unless it is fresh or has no FIXTURE_RESET() */
+void fixtureReset(void);
+
+/** Marks the current fixture to be set up again before its next use, since a variant failed */
+void fixtureBreak(void);
+
+/** Tears down every fixture the calling thread set up for an object, or all of them if `dl` is NULL */
+void fixtureRelease(const struct DL *dl);
+
+
+/* numa.c */
+
+/** The NUMA node of the CPU the calling runner is pinned to, or -1 if it isn't pinned or there is only one node */
+extern __thread int numaNode;
+/** The number of NUMA nodes, or 0 before numaInit() */
+extern size_t numaNodes;
+
+/** Reads the CPUs available to the process and the NUMA topology from sysfs
+	@returns false and prints an error message on failure
+ */
+bool numaInit(void);
+
+/** Pins the calling runner to a CPU, alternating between NUMA nodes, and sets `numaNode`
+	@param index The index of the runner
+ */
+void numaPin(size_t index);
+
+/** Lets the calling thread run on any CPU again */
+void numaUnpin(void);
+
+/** Copies the data of every provider in a bucket onto each NUMA node, if there are several and `--pin` is given.
+	Must be called before the bucket becomes complete, since runners read the replicas without locking.
+ */
+void numaReplicate(struct ProviderBucket *b);
+
+/** Frees the replicas of a provider's data */
+void numaRelease(struct Provider *p, size_t elementSize);
+
+/** Frees the topology read by numaInit() */
+void numaCleanup(void);
+
+
+/* profile.c */
+
+/** Installs the SIGPROF handler of `--profile`
+	@returns false and prints an error message on failure
+ */
+bool profileStart(void);
+
+/** Starts sampling the calling runner, if `--profile` is given */
+void profileThreadInit(void);
+
+/** Stops sampling the calling runner */
+void profileThreadClose(void);
+
+/** Attributes the following samples of the calling runner to a test */
+void profileTestStart(const struct DL *dl, const struct Test *test);
+
+/** Symbolizes the samples taken during the calling runner's test, while every object they may point into is still loaded */
+void profileTestEnd(void);
+
+/** Prints the hottest functions of every profiled test, writes the collapsed stacks to `options.flamegraph` and discards the samples */
+void profileReport(void);
+
+
+/* derive.c */
+
+/** @returns Whether a provider was declared with DERIVED_PROVIDER() */
+bool isDerived(const struct DL *dl, const char *name);
+
+/** @returns Whether every source of a derived provider is loaded */
+bool deriveReady(const struct DL *dl, const char *name);
+
+/** Checks whether a derived provider needs a type that no test takes, so that its sources aren't skipped by planProviders()
+	@param type The type of the provider
+	@param types [0 ; typeCount) -> the types needed so far
+	@returns The type of a source missing from `types`, or NULL if there is none or the provider itself isn't needed
+ */
+const char *deriveMissingType(const struct DL *dl, const char *name, const char *type, size_t typeCount, const char *const types[static typeCount]);
+
+/** Resolves the sources of a derived provider and registers it. Only filters evaluate anything right away.
+	@param format The formatter of the provider's object, or NULL to use that of another provider of the same type
+	@returns false and prints an error message on failure
+ */
+bool deriveProvider(struct DL *dl, const char *name, const char *type, size_t size, format_f format);
+
+/** Computes an element of a derived provider, as locateArg() */
+const void *deriveArg(const struct Provider *p, size_t dataPosition, void *scratch);
+
+/** @returns The number of `scratch_t` holding an element of any of the given buckets, for use as scratch of locateArg() */
+size_t scratchWords(unsigned count, struct ProviderBucket *const buckets[static count]);
+
+/** Locates the sources of every derived provider again after providers were removed,
+	removing derived providers whose sources are gone
+ */
+void deriveRelink(void);
+
+
+/* watch.c */
+
+/** Waits for changes to any subject or test object and re-runs the affected tests.
+	Only returns if watching the files fails.
+	@param subjects [0 ; subjectCount) -> subject handles, updated on reload
+	@param subjectNames [0 ; subjectCount) -> the paths of the subjects
+ */
+void watch(size_t subjectCount, void *subjects[static subjectCount], const char *const subjectNames[static subjectCount]);
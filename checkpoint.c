@@ -0,0 +1,659 @@
+/* --checkpoint and --resume: Periodically records the progress of a run, so that an interrupted run can continue where it stopped.
+	The checkpoint holds one line of tab-separated fields per test:
+	`done`, the module, the test, whether it passed and its number of variants for finished tests, or
+	`test`, the module, the test, its number of variants so far, the number of types followed by the selected provider of each,
+	and the arity followed by the data index of each argument for tests in progress.
+	Provider data is saved next to it in `<checkpoint>.providers` once generated, since providers may be randomized.
+	Data that holds pointers would point into the interrupted process, so such providers are only named there, generated anew when resuming,
+	and tests in progress start over.
+*/
+#include "ccheck.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The first line of a checkpoint */
+#define MAGIC "CCHECK-CHECKPOINT"
+
+size_t checkpointEpoch = 0;
+__thread size_t checkpointSeen = 0;
+
+/** The progress of a test */
+struct Progress
+{
+	/** malloc()ed names of the test and of its object, as given on the command line */
+	char *module, *test;
+	/** Whether the test finished, and if so whether it passed */
+	bool done, passed;
+	/** Set once a resumed test started running again, after which its runner's slot holds its progress */
+	bool taken;
+	/** The number of variants run so far */
+	size_t variants;
+	unsigned int typeCount, arity;
+	/** The odometer of the test's variant loop, pointing at the next variant to run */
+	size_t providers[MAX_ARITY], indices[MAX_ARITY];
+};
+
+/** The progress published by a runner */
+struct Slot
+{
+	/** The test running on the slot's thread, or NULL */
+	const struct DL *dl;
+	const struct Test *test;
+	size_t variants;
+	size_t providers[MAX_ARITY], indices[MAX_ARITY];
+	struct Slot *next;
+};
+
+/** Provider data saved by a previous run */
+struct Snapshot
+{
+	/** malloc()ed names of the provider's object and of the provider */
+	char *dlName, *name;
+	size_t elementSize, count;
+	/** malloc()ed data, or NULL once taken */
+	void *data;
+	/** Whether the provider held pointers, so that its data wasn't saved */
+	bool pointers;
+};
+
+/** Guards `progress`, `progressCount` and `slots` */
+static pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER;
+/** Tests that finished, and those in progress when the resumed checkpoint was written */
+static struct Progress *progress = NULL;
+static size_t progressCount = 0;
+/** The slot of every runner that ran a test so far */
+static struct Slot *slots = NULL;
+static __thread struct Slot *slot = NULL;
+
+static struct Snapshot *snapshots = NULL;
+static size_t snapshotCount = 0;
+/** Set if a provider of the interrupted run held pointers, after which tests in progress can't continue */
+static bool regenerated = false;
+
+/** Guards `stopping` */
+static pthread_mutex_t timerLock = PTHREAD_MUTEX_INITIALIZER;
+/** Signalled once `stopping` is set */
+static pthread_cond_t timerStop = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;
+static pthread_t timer;
+static bool timerRunning = false;
+/** Set once provider data was saved, before which checkpoints can't be resumed */
+static bool snapshotSaved = false;
+
+/** @returns The entry of a test in `progress`, or NULL. Must be called with `checkpointLock` held. */
+static struct Progress *findProgress(const char *module, const char *test)
+{
+	for(size_t i = 0; i < progressCount; ++i)
+	{
+		if(strcmp(progress[i].module, module) == 0 && strcmp(progress[i].test, test) == 0)
+			return &progress[i];
+	}
+
+	return NULL;
+}
+
+/** Adds an entry to `progress`. Must be called with `checkpointLock` held.
+	@returns NULL on failure
+ */
+static struct Progress *addProgress(const char *module, const char *test)
+{
+	struct Progress *r = realloc(progress, (progressCount + 1) * sizeof(struct Progress));
+
+	if(r == NULL)
+		return NULL;
+
+	progress = r;
+	r = &progress[progressCount];
+	*r = (struct Progress){ .module = strdup(module), .test = strdup(test) };
+
+	if(r->module == NULL || r->test == NULL)
+	{
+		free(r->module);
+		free(r->test);
+		return NULL;
+	}
+
+	++progressCount;
+	return r;
+}
+
+/** Parses a list of numbers preceded by its length
+	@param fields Receives the remaining fields
+	@returns false if the list is malformed
+ */
+static bool parseList(char **fields, unsigned int *count, size_t list[static MAX_ARITY])
+{
+	char *end;
+	*count = strtoul(*fields, &end, 10);
+
+	if(end == *fields || *count > MAX_ARITY)
+		return false;
+
+	for(unsigned int i = 0; i < *count; ++i)
+	{
+		if(*end != '\t')
+			return false;
+
+		char *start = end + 1;
+		list[i] = strtoull(start, &end, 10);
+
+		if(end == start)
+			return false;
+	}
+
+	*fields = *end == '\t' ? end + 1 : end;
+	return true;
+}
+
+/** Parses a line of a checkpoint, adding it to `progress`
+	@returns false if it is malformed
+ */
+static bool parseProgress(char *line)
+{
+	char *fields[4], *rest = line;
+
+	// the remaining fields depend on the kind of entry
+	for(size_t n = 0; n < 4; ++n)
+	{
+		fields[n] = rest;
+		rest = strchr(rest, '\t');
+
+		if(rest == NULL)
+			return false;
+
+		*rest++ = 0;
+	}
+
+	bool done = strcmp(fields[0], "done") == 0;
+	char *end;
+	struct Progress p = { .done = done };
+
+	if(!done && strcmp(fields[0], "test") != 0)
+		return false;
+
+	if(done)
+	{
+		p.passed = strcmp(fields[3], "1") == 0;
+		p.variants = strtoull(rest, &end, 10);
+
+		if(end == rest || *end)
+			return false;
+	}
+	else
+	{
+		p.variants = strtoull(fields[3], &end, 10);
+
+		if(end == fields[3] || *end || !parseList(&rest, &p.typeCount, p.providers) || !parseList(&rest, &p.arity, p.indices) || *rest)
+			return false;
+	}
+
+	struct Progress *added = addProgress(fields[1], fields[2]);
+
+	if(added == NULL)
+		return false;
+
+	p.module = added->module;
+	p.test = added->test;
+	*added = p;
+	return true;
+}
+
+/** Reads the provider data saved along with the checkpoint */
+static void loadSnapshots(void)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s.providers", options.checkpoint);
+	FILE *f = fopen(path, "r");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't read saved provider data, so providers are generated anew: fopen(%s): %s\n"), path, strerror(errno));
+		return;
+	}
+
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+
+	while((len = getline(&line, &cap, f)) > 0)
+	{
+		struct Snapshot s = {0};
+		char *tab1 = strchr(line, '\t'), *tab2 = tab1 ? strchr(tab1 + 1, '\t') : NULL;
+		if(line[len - 1] == '\n')
+			line[len - 1] = 0;
+
+		char kind[16];
+
+		if(tab2 == NULL || sscanf(tab2 + 1, "%zu\t%15s", &s.elementSize, kind) != 2)
+			break;
+
+		s.pointers = strcmp(kind, "pointers") == 0;
+
+		if(!s.pointers && sscanf(kind, "%zu", &s.count) != 1)
+			break;
+
+		*tab1 = *tab2 = 0;
+		s.dlName = strdup(line);
+		s.name = strdup(tab1 + 1);
+		s.data = s.pointers ? NULL : malloc(s.elementSize * s.count + 1);
+		struct Snapshot *r = realloc(snapshots, (snapshotCount + 1) * sizeof(struct Snapshot));
+
+		if(r)
+			snapshots = r;
+
+		if(!r || !s.dlName || !s.name || (!s.pointers && (!s.data || fread(s.data, s.elementSize, s.count, f) != s.count)))
+		{
+			free(s.dlName);
+			free(s.name);
+			free(s.data);
+			break;
+		}
+
+		if(s.pointers)
+		{
+			fprintf(stderr, YELLOW("Provider %s::%s holds pointers, which can't be restored, so it is generated anew and partially run tests start over\n"),
+				s.dlName, s.name);
+			regenerated = true;
+		}
+
+		snapshots[snapshotCount++] = s;
+	}
+
+	if(! feof(f))
+		fprintf(stderr, YELLOW("Saved provider data in '%s' is truncated, so later providers are generated anew\n"), path);
+
+	free(line);
+	fclose(f);
+}
+
+bool checkpointLoad(void)
+{
+	FILE *f = fopen(options.checkpoint, "r");
+
+	if(f == NULL)
+	{
+		if(errno == ENOENT)
+		{
+			printf("No checkpoint in '%s', starting from the beginning.\n", options.checkpoint);
+			return true;
+		}
+
+		fprintf(stderr, RED_BOLD("Couldn't resume") ": fopen(%s): %s\n", options.checkpoint, strerror(errno));
+		return false;
+	}
+
+	char *line = NULL;
+	size_t cap = 0, done = 0, running = 0;
+	ssize_t len = getline(&line, &cap, f);
+	bool ok = len > 0 && strncmp(line, MAGIC "\n", len) == 0;
+
+	while(ok && (len = getline(&line, &cap, f)) > 0)
+	{
+		if(line[len - 1] == '\n')
+			line[--len] = 0;
+
+		if(! parseProgress(line))
+			ok = false;
+	}
+
+	free(line);
+	fclose(f);
+
+	if(! ok)
+	{
+		fprintf(stderr, RED_BOLD("Couldn't resume") ": '%s' is not a valid checkpoint\n", options.checkpoint);
+		return false;
+	}
+
+	for(size_t i = 0; i < progressCount; ++i)
+	{
+		done += progress[i].done;
+		running += !progress[i].done;
+	}
+
+	loadSnapshots();
+	printf("Resuming with %zu finished and %zu partially run %s.\n", done, CONJUGATE(running, "test"));
+	return true;
+}
+
+void *checkpointTakeProvider(const char *dlName, const char *name, size_t size, size_t *count)
+{
+	for(size_t i = 0; i < snapshotCount; ++i)
+	{
+		struct Snapshot *s = &snapshots[i];
+
+		if(s->data && s->elementSize == size && strcmp(s->dlName, dlName) == 0 && strcmp(s->name, name) == 0)
+		{
+			void *data = s->data;
+			*count = s->count;
+			s->data = NULL;
+			return data;
+		}
+	}
+
+	return NULL;
+}
+
+/** Writes provider data next to the checkpoint
+	@returns false and prints an error message on failure
+ */
+static bool saveSnapshots(void)
+{
+	char path[PATH_MAX], tmp[PATH_MAX];
+	snprintf(path, sizeof(path), "%s.providers", options.checkpoint);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *f = fopen(tmp, "w");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't save provider data for checkpoints: fopen(%s): %s\n"), tmp, strerror(errno));
+		return false;
+	}
+
+	// derived providers are computed from the saved ones again
+	for(struct ProviderBucket *b = providerRoot; b; b = b->next)
+	{
+		for(size_t i = 0; i < b->count; ++i)
+		{
+			const struct Provider *p = &b->providers[i];
+
+			if(p->derived)
+				continue;
+
+			if(holdsPointers(b, i))
+			{
+				fprintf(f, "%s\t%s\t%zu\tpointers\n", p->dlName, p->name, b->elementSize);
+				continue;
+			}
+
+			fprintf(f, "%s\t%s\t%zu\t%zu\n", p->dlName, p->name, b->elementSize, p->count);
+			fwrite(p->data, b->elementSize, p->count, f);
+		}
+	}
+
+
+	if(fclose(f) || rename(tmp, path))
+	{
+		fprintf(stderr, YELLOW("Couldn't save provider data for checkpoints to '%s': %s\n"), path, strerror(errno));
+		unlink(tmp);
+		return false;
+	}
+
+	return true;
+}
+
+/** Writes a list of numbers preceded by its length */
+static void writeList(FILE *f, unsigned int count, const size_t list[])
+{
+	fprintf(f, "\t%u", count);
+
+	for(unsigned int i = 0; i < count; ++i)
+		fprintf(f, "\t%zu", list[i]);
+}
+
+/** Replaces the checkpoint with the progress published so far */
+static void writeCheckpoint(void)
+{
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", options.checkpoint);
+	FILE *f = fopen(tmp, "w");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't write checkpoint: fopen(%s): %s\n"), tmp, strerror(errno));
+		return;
+	}
+
+	fputs(MAGIC "\n", f);
+	pthread_mutex_lock(&checkpointLock);
+
+	for(size_t i = 0; i < progressCount; ++i)
+	{
+		const struct Progress *p = &progress[i];
+
+		if(p->done)
+			fprintf(f, "done\t%s\t%s\t%d\t%zu\n", p->module, p->test, p->passed, p->variants);
+		else if(! p->taken)
+		{
+			fprintf(f, "test\t%s\t%s\t%zu", p->module, p->test, p->variants);
+			writeList(f, p->typeCount, p->providers);
+			writeList(f, p->arity, p->indices);
+			fputc('\n', f);
+		}
+	}
+
+	for(const struct Slot *s = slots; s; s = s->next)
+	{
+		if(s->test == NULL)
+			continue;
+
+		fprintf(f, "test\t%s\t%s\t%zu", s->dl->name, s->test->name, s->variants);
+		writeList(f, s->test->sig.typeCount, s->providers);
+		writeList(f, s->test->sig.arity, s->indices);
+		fputc('\n', f);
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+
+	if(fclose(f) || rename(tmp, options.checkpoint))
+	{
+		fprintf(stderr, YELLOW("Couldn't write checkpoint '%s': %s\n"), options.checkpoint, strerror(errno));
+		unlink(tmp);
+	}
+}
+
+/** Writes a checkpoint every `options.checkpointInterval` seconds until stopped, as a pthread entry point
+	@returns NULL
+ */
+static void *checkpointTimer(void *_)
+{
+	(void)_;
+	pthread_mutex_lock(&timerLock);
+
+	while(! stopping)
+	{
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		double t = until.tv_sec + until.tv_nsec * 1e-9 + options.checkpointInterval;
+		until.tv_sec = t;
+		until.tv_nsec = (t - until.tv_sec) * 1e9;
+
+		if(pthread_cond_timedwait(&timerStop, &timerLock, &until) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&timerLock);
+
+		if(__atomic_load_n(&snapshotSaved, __ATOMIC_ACQUIRE))
+			writeCheckpoint();
+
+		// runners publish their progress as they notice, in time for the next checkpoint
+		__atomic_fetch_add(&checkpointEpoch, 1, __ATOMIC_RELAXED);
+		pthread_mutex_lock(&timerLock);
+	}
+
+	pthread_mutex_unlock(&timerLock);
+	return NULL;
+}
+
+void checkpointStart(void)
+{
+	if(options.checkpoint == NULL)
+		return;
+
+	stopping = false;
+	int e = pthread_create(&timer, NULL, checkpointTimer, NULL);
+
+	if(e)
+		fprintf(stderr, YELLOW("No checkpoints will be written: pthread_create(): %s\n"), strerror(e));
+
+	timerRunning = !e;
+}
+
+void checkpointProvidersDone(void)
+{
+	if(options.checkpoint && timerRunning && saveSnapshots())
+		__atomic_store_n(&snapshotSaved, true, __ATOMIC_RELEASE);
+}
+
+void checkpointStop(void)
+{
+	if(! timerRunning)
+		return;
+
+	pthread_mutex_lock(&timerLock);
+	stopping = true;
+	pthread_cond_signal(&timerStop);
+	pthread_mutex_unlock(&timerLock);
+	pthread_join(timer, NULL);
+	timerRunning = false;
+
+	// the run finished, so there is nothing left to resume
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s.providers", options.checkpoint);
+	unlink(options.checkpoint);
+	unlink(path);
+
+	for(size_t i = 0; i < progressCount; ++i)
+	{
+		free(progress[i].module);
+		free(progress[i].test);
+	}
+
+	for(size_t i = 0; i < snapshotCount; ++i)
+	{
+		free(snapshots[i].dlName);
+		free(snapshots[i].name);
+		free(snapshots[i].data);
+	}
+
+	for(struct Slot *s = slots, *next; s; s = next)
+	{
+		next = s->next;
+		free(s);
+	}
+
+	free(progress);
+	free(snapshots);
+	progress = NULL;
+	snapshots = NULL;
+	slots = NULL;
+	progressCount = snapshotCount = 0;
+	regenerated = false;
+}
+
+bool checkpointSkip(struct DL *dl, const struct Test *test)
+{
+	pthread_mutex_lock(&checkpointLock);
+	const struct Progress *p = findProgress(dl->name, test->name);
+	bool done = p && p->done;
+
+	if(done)
+	{
+		dl->variants += p->variants;
+		dl->succeeded += p->passed;
+		dl->failed += !p->passed;
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+	return done;
+}
+
+size_t checkpointTestStart(const struct DL *dl, const struct Test *test, struct ProviderBucket *const buckets[], size_t providers[static MAX_ARITY], size_t indices[static MAX_ARITY])
+{
+	if(! timerRunning)
+		return 0;
+
+	pthread_mutex_lock(&checkpointLock);
+
+	if(slot == NULL && (slot = calloc(1, sizeof(struct Slot))))
+	{
+		slot->next = slots;
+		slots = slot;
+	}
+
+	struct Progress *p = findProgress(dl->name, test->name);
+	bool valid = p && !p->done && !p->taken && !regenerated && p->typeCount == test->sig.typeCount && p->arity == test->sig.arity;
+
+	// providers may have changed since the checkpoint was written
+	for(unsigned int t = 0; valid && t < p->typeCount; ++t)
+		valid = p->providers[t] < buckets[t]->count;
+	for(unsigned int i = 0; valid && i < p->arity; ++i)
+		valid = p->indices[i] < buckets[test->sig.argTypeIndices[i]]->providers[p->providers[test->sig.argTypeIndices[i]]].count;
+
+	size_t variants = valid ? p->variants : 0;
+
+	if(valid)
+	{
+		p->taken = true;
+		memcpy(providers, p->providers, sizeof(p->providers));
+		memcpy(indices, p->indices, sizeof(p->indices));
+	}
+	else if(p && !p->done && !p->taken)
+	{
+		// the runner's slot holds its progress from now on
+		p->taken = true;
+
+		if(! regenerated)
+			fprintf(stderr, YELLOW("Restarting %s::%s, since its providers changed since the checkpoint\n"), dl->name, test->name);
+	}
+
+	if(slot)
+	{
+		slot->dl = dl;
+		slot->test = test;
+		slot->variants = variants;
+		memcpy(slot->providers, providers, sizeof(slot->providers));
+		memcpy(slot->indices, indices, sizeof(slot->indices));
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+	checkpointSeen = __atomic_load_n(&checkpointEpoch, __ATOMIC_RELAXED);
+	return variants;
+}
+
+void checkpointPublish(size_t variants, const size_t providers[static MAX_ARITY], const size_t indices[static MAX_ARITY])
+{
+	checkpointSeen = __atomic_load_n(&checkpointEpoch, __ATOMIC_RELAXED);
+
+	if(slot == NULL || slot->test == NULL)
+		return;
+
+	pthread_mutex_lock(&checkpointLock);
+	slot->variants = variants;
+	memcpy(slot->providers, providers, sizeof(slot->providers));
+	memcpy(slot->indices, indices, sizeof(slot->indices));
+	pthread_mutex_unlock(&checkpointLock);
+}
+
+void checkpointTestEnd(const struct DL *dl, const struct Test *test, bool passed, size_t variants)
+{
+	if(! timerRunning)
+		return;
+
+	pthread_mutex_lock(&checkpointLock);
+	struct Progress *p = findProgress(dl->name, test->name);
+
+	if(p == NULL)
+		p = addProgress(dl->name, test->name);
+
+	if(p)
+	{
+		p->done = true;
+		p->passed = passed;
+		p->variants = variants;
+	}
+
+	if(slot)
+	{
+		slot->dl = NULL;
+		slot->test = NULL;
+	}
+
+	pthread_mutex_unlock(&checkpointLock);
+}
@@ -0,0 +1,398 @@
+/* --compare: Runs the same variants against two builds of a subject, each loaded into its own link-map namespace */
+#include "ccheck.h"
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** The number of diverging variants printed per test */
+#define MAX_DIVERGENCE_REPORTS 5
+/** The lower limit for a measured duration, in seconds, so that ratios stay finite */
+#define MIN_DURATION 1e-9
+/** The z-score of the two-sided 95% confidence interval */
+#define Z_95 1.96
+/** The size of a copied dlerror() message */
+#define DLERROR_SIZE 512
+
+/** One of the compared builds */
+struct Build
+{
+	/** The path given to `--compare` */
+	const char *subject;
+	/** The namespace it was loaded into */
+	Lmid_t ns;
+	/** [0 ; dlCount) -> the copy of each test object in `ns` */
+	struct DL *modules;
+};
+
+/** Copies the message of dlerror(), which only stays valid until the next call into the dynamic linker of any namespace
+	@returns `buf`
+ */
+static const char *copyDlerror(char buf[static DLERROR_SIZE])
+{
+	const char *e = dlerror();
+	snprintf(buf, DLERROR_SIZE, "%s", e ? e : "Unknown error");
+	return buf;
+}
+
+/** Loads ccheck-shim.so into a new namespace, which pulls in the subject through a symlink next to it.
+	@returns false and prints an error message on failure
+ */
+static bool openNamespace(struct Build *b)
+{
+	char exe[PATH_MAX], subject[PATH_MAX], dir[] = "/tmp/ccheck-compare-XXXXXX", link[PATH_MAX + 32];
+	ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	bool ok = false;
+
+	if(n < 0 || !realpath(b->subject, subject))
+	{
+		fprintf(stderr, RED_BOLD("Error loading") " '%s': %s\n", n < 0 ? "/proc/self/exe" : b->subject, strerror(errno));
+		return false;
+	}
+
+	exe[n] = 0;
+	// the shim is installed next to the ccheck executable
+	strcpy(strrchr(exe, '/') + 1, "ccheck-shim.so");
+
+	if(mkdtemp(dir) == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Error loading") " '%s': mkdtemp(): %s\n", b->subject, strerror(errno));
+		return false;
+	}
+
+	snprintf(link, sizeof(link), "%s/ccheck-subject.so", dir);
+
+	if(symlink(subject, link))
+	{
+		fprintf(stderr, RED_BOLD("Error loading") " '%s': symlink(): %s\n", b->subject, strerror(errno));
+		goto cleanup;
+	}
+
+	snprintf(link, sizeof(link), "%s/ccheck-shim.so", dir);
+
+	if(symlink(exe, link))
+	{
+		fprintf(stderr, RED_BOLD("Error loading") " '%s': symlink(): %s\n", b->subject, strerror(errno));
+		goto cleanup;
+	}
+
+	void *shim = dlmopen(LM_ID_NEWLM, link, RTLD_NOW);
+	struct ShimHooks *hooks;
+
+	if(shim == NULL || (hooks = dlsym(shim, "_ccheckHooks")) == NULL || dlinfo(shim, RTLD_DI_LMID, &b->ns))
+	{
+		char e[DLERROR_SIZE];
+		fprintf(stderr, RED_BOLD("Error loading") " '%s': %s\n", b->subject, copyDlerror(e));
+		goto cleanup;
+	}
+
+	*hooks = (struct ShimHooks){
+		.testFailureV = testFailureV,
+		.testSuccess = testSuccess,
+		.expectExit = expectExit,
+		.undoExpectExit = undoExpectExit,
+		.exit = exit,
+		.assertFail = __assert_fail,
+		.asyncRead = asyncRead,
+		.asyncWrite = asyncWrite,
+		.asyncYield = asyncYield,
+		.testFixture = testFixture,
+	};
+	ok = true;
+
+	// everything is mapped, so the links aren't needed anymore
+	cleanup:
+	snprintf(link, sizeof(link), "%s/ccheck-shim.so", dir);
+	unlink(link);
+	snprintf(link, sizeof(link), "%s/ccheck-subject.so", dir);
+	unlink(link);
+	rmdir(dir);
+
+	return ok;
+}
+
+/** Opens a test object in the namespace of a build
+	@returns false and prints an error message on failure
+ */
+static bool openIn(const struct Build *b, const char *path, struct DL *dl)
+{
+	*dl = (struct DL){ .name = path };
+	void *handle = dlmopen(b->ns, path, RTLD_NOW | RTLD_LOCAL);
+
+	if(handle == NULL)
+	{
+		char e[DLERROR_SIZE];
+		fprintf(stderr, RED_BOLD("Error loading")" '%s' for '%s': %s\n", path, b->subject, copyDlerror(e));
+		return false;
+	}
+	if(! loadDL(handle, path, dl))
+	{
+		dlclose(handle);
+		return false;
+	}
+
+	return true;
+}
+
+/** Runs and times a single variant against one build
+	@param seconds Receives the duration of the call
+	@param message Receives the failure reason, if any
+	@returns true if the variant succeeded
+ */
+static bool timeVariant(test_f func, unsigned int arity, const void *const args[], double *seconds, char message[static TEST_MESSAGE_SIZE])
+{
+	double start = now();
+	bool ok = runVariant(func, arity, args);
+	*seconds = now() - start;
+
+	if(*seconds < MIN_DURATION)
+		*seconds = MIN_DURATION;
+	if(! ok)
+		memcpy(message, runningTest.message, TEST_MESSAGE_SIZE);
+
+	return ok;
+}
+
+/** Prints a variant whose result differs between the builds */
+static void printDivergence(const struct DL *dl, const struct Test *test, struct ProviderBucket *const buckets[], const size_t providers[],
+	const size_t indices[], const void *const args[], bool oldOk, const char *message)
+{
+	char buffer[2048];
+	size_t w = 0;
+
+	// keeps w < sizeof(buffer), since snprintf() reports the length it would have written
+	#define APPEND(expr) do { w += (expr); if(w >= sizeof(buffer)) w = sizeof(buffer) - 1; } while(0)
+	APPEND(snprintf(buffer, sizeof(buffer), RED_BOLD("Diverging variant") " %s::%s(", dl->name, test->name));
+
+	for(unsigned int i = 0; i < test->sig.arity; ++i)
+	{
+		size_t ti = test->sig.argTypeIndices[i];
+		const struct Provider *p = &buckets[ti]->providers[providers[ti]];
+
+		APPEND(snprintf(buffer + w, sizeof(buffer) - w, "%s %s = ", i ? "," : "", test->sig.argNames[i]));
+		APPEND(p->format(buffer + w, sizeof(buffer) - w, args[i]));
+		APPEND(snprintf(buffer + w, sizeof(buffer) - w, " (%s::%s #%zu)", p->dlName, p->name, indices[i]));
+	}
+
+	APPEND(snprintf(buffer + w, sizeof(buffer) - w, " ): %s build failed: %s", oldOk ? "new" : "old", message));
+	#undef APPEND
+
+	puts(buffer);
+}
+
+/** Runs every variant of a test against both builds, alternating which one goes first
+	@param newFunc The test function in the new build's namespace
+	@returns The number of diverging variants
+ */
+static size_t compareTest(struct DL *dl, const struct Test *test, test_f newFunc)
+{
+	const unsigned int arity = test->sig.arity, typeCount = test->sig.typeCount;
+	const int *argTypeIndices = test->sig.argTypeIndices;
+	struct ProviderBucket *buckets[MAX_ARITY];
+	size_t bucketSizes[MAX_ARITY];
+
+	for(size_t i = 0; i < typeCount; ++i)
+	{
+		struct ProviderBucket *pb = findProvider(test->sig.argTypes[i]);
+
+		if(pb == NULL || pb->count == 0)
+		{
+			fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: No providers registered for type '%s'.\n", dl->name, test->name, test->sig.argTypes[i]);
+			++dl->failed;
+			return 0;
+		}
+
+		buckets[i] = pb;
+		bucketSizes[i] = pb->count;
+	}
+
+	size_t curProviders[MAX_ARITY] = {0}, curDataCounts[MAX_ARITY], curDataIndices[MAX_ARITY];
+	const void *args[MAX_ARITY];
+	scratch_t scratch[arity ? arity : 1][scratchWords(typeCount, buckets)];
+	char oldMessage[TEST_MESSAGE_SIZE], newMessage[TEST_MESSAGE_SIZE];
+	size_t variants = 0, timed = 0, diverged = 0, bothFailed = 0;
+	/** Sum and sum of squares of ln(new time / old time) over variants that passed on both builds */
+	double sum = 0, sumSq = 0;
+
+	do
+	{
+		for (size_t i = 0; i < arity; ++i)
+			curDataCounts[i] = buckets[argTypeIndices[i]]->providers[curProviders[argTypeIndices[i]]].count;
+
+		memset(curDataIndices, 0, sizeof(curDataIndices));
+
+		do
+		{
+			for (size_t i = 0; i < arity; ++i)
+				args[i] = locateArg(buckets[argTypeIndices[i]], curProviders[argTypeIndices[i]], curDataIndices[i], scratch[i]);
+
+			double oldTime, newTime;
+			bool oldOk, newOk;
+
+			// alternating the order cancels out warm-up effects of the first call
+			if(variants++ & 1)
+			{
+				newOk = timeVariant(newFunc, arity, args, &newTime, newMessage);
+				oldOk = timeVariant(test->func, arity, args, &oldTime, oldMessage);
+			}
+			else
+			{
+				oldOk = timeVariant(test->func, arity, args, &oldTime, oldMessage);
+				newOk = timeVariant(newFunc, arity, args, &newTime, newMessage);
+			}
+
+			if(oldOk && newOk)
+			{
+				double r = log(newTime / oldTime);
+				sum += r;
+				sumSq += r * r;
+				++timed;
+			}
+			else if(oldOk != newOk)
+			{
+				if(diverged++ < MAX_DIVERGENCE_REPORTS)
+					printDivergence(dl, test, buckets, curProviders, curDataIndices, args, oldOk, oldOk ? newMessage : oldMessage);
+			}
+			else
+				++bothFailed;
+		} while(nextCombination(arity, curDataCounts, curDataIndices));
+	} while(nextCombination(typeCount, bucketSizes, curProviders));
+
+	dl->variants += variants;
+
+	if(diverged || bothFailed)
+		++dl->failed;
+	else
+		++dl->succeeded;
+
+	if(diverged > MAX_DIVERGENCE_REPORTS)
+		printf(RED("... and %zu more diverging variants of %s::%s\n"), diverged - MAX_DIVERGENCE_REPORTS, dl->name, test->name);
+	if(bothFailed)
+		printf(YELLOW("%zu %s of %s::%s failed on both builds\n"), CONJUGATE(bothFailed, "variant"), dl->name, test->name);
+	if(timed < 2)
+	{
+		printf("%s::%s: Too few passing variants to compare timings\n", dl->name, test->name);
+		return diverged;
+	}
+
+	// confidence interval of the geometric mean of the per-variant time ratios
+	double mean = sum / timed;
+	double sd = sqrt(fmax(0, (sumSq - timed * mean * mean) / (timed - 1)));
+	double lo = exp(mean - Z_95 * sd / sqrt(timed)), hi = exp(mean + Z_95 * sd / sqrt(timed)), ratio = exp(mean);
+	const char *verdict = hi < 1 ? "\x1B[92mfaster\x1B[0m" : lo > 1 ? "\x1B[31mslower\x1B[0m" : "no significant difference";
+
+	printf("%s::%s: new/old time %.3fx (95%% CI %.3fx - %.3fx) over %zu %s, %s\n",
+		dl->name, test->name, ratio, lo, hi, CONJUGATE(timed, "variant"), verdict);
+
+	return diverged;
+}
+
+int compareBuilds(int argc, char **argv)
+{
+	if(argc == 0 || strcmp(argv[0], "--") != 0)
+	{
+		fprintf(stderr, RED_BOLD("Invalid arguments") ": --compare takes the place of subjects, so test objects must follow right after `--`\n");
+		return 1;
+	}
+
+	struct Build builds[2] = { { .subject = options.compareOld }, { .subject = options.compareNew } };
+	size_t moduleCount = argc - 1;
+	size_t diverged = 0, totalVariants = 0, totalSucceeded = 0, totalFailed = 0;
+
+	dls = calloc(moduleCount, sizeof(struct DL));
+	builds[1].modules = calloc(moduleCount, sizeof(struct DL));
+
+	if(dls == NULL || builds[1].modules == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Out of memory") "\n");
+		return 1;
+	}
+
+	// the old build's copies double as the regular modules, so that providers are run once and shared
+	builds[0].modules = dls;
+	dlCount = moduleCount;
+
+	for(int b = 0; b < 2; ++b)
+	{
+		if(! openNamespace(&builds[b]))
+			return 1;
+
+		for(size_t i = 0; i < moduleCount; ++i)
+			linkerErrors |= !openIn(&builds[b], argv[i + 1], &builds[b].modules[i]);
+	}
+
+	printf("Comparing '%s' against '%s' with %zu test %s.\n", builds[1].subject, builds[0].subject, CONJUGATE3(moduleCount, "object", "objects"));
+
+	// interleaving on one core keeps frequency scaling and cache effects equal for both builds
+	int cpu = sched_getcpu();
+	cpu_set_t set;
+	CPU_ZERO(&set);
+
+	if(cpu >= 0)
+	{
+		CPU_SET(cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	planProviders();
+	generateProviders();
+
+	for(size_t i = 0; i < moduleCount; ++i)
+	{
+		struct DL *dl = &dls[i], *newDl = &builds[1].modules[i];
+
+		if(dl->handle == NULL || newDl->handle == NULL)
+			continue;
+
+		struct Test *tests;
+		size_t testCount = collectTests(dl, &tests);
+
+		for(size_t t = 0; t < testCount; ++t)
+		{
+			// the setup of a fixture would have to run in both namespaces and stay paired with them
+			if(tests[t].fixture)
+			{
+				fprintf(stderr, YELLOW("Not comparing test %s::%s: Tests with fixtures can't be compared\n"), dl->name, tests[t].name);
+				continue;
+			}
+
+			char name[strlen(tests[t].name) + 7];
+			snprintf(name, sizeof(name), "_TEST_%s", tests[t].name);
+			test_f newFunc = (test_f)(size_t)dlsym(newDl->handle, name);
+
+			if(newFunc == NULL)
+			{
+				fprintf(stderr, RED_BOLD("Couldn't compare test") " %s::%s: Missing from the copy for '%s'\n", dl->name, tests[t].name, builds[1].subject);
+				++dl->failed;
+				continue;
+			}
+
+			diverged += compareTest(dl, &tests[t], newFunc);
+		}
+
+		free(tests);
+		totalVariants += dl->variants;
+		totalSucceeded += dl->succeeded;
+		totalFailed += dl->failed;
+	}
+
+	printf("Summary: Compared %zu %s with %zu %s,\x1B[%u;1m got %zu diverging %s\x1B[0m\n",
+		CONJUGATE(totalSucceeded + totalFailed, "test"), CONJUGATE(totalVariants, "variant"),
+		diverged ? 31 : 92, CONJUGATE(diverged, "variant"));
+
+	for(int b = 1; b >= 0; --b)
+	{
+		for(size_t i = 0; i < moduleCount; ++i)
+			closeModule(&builds[b].modules[i]);
+	}
+
+	free(builds[1].modules);
+	return linkerErrors || totalFailed > 0;
+}
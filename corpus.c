@@ -0,0 +1,267 @@
+/* --corpus: Provides the files of a directory or packed corpus as CorpusEntry values, without copying them */
+#include "ccheck.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The first line of a packed corpus file */
+#define PACKED_MAGIC "CCHECK-CORPUS\n"
+/** The name corpus providers report as their object */
+#define CORPUS_DL "--corpus"
+
+/** A region mapped for a corpus */
+struct Mapping
+{
+	void *addr;
+	size_t len;
+};
+
+/** Every region mapped so far, unmapped by corpusUnload() */
+static struct Mapping *mappings = NULL;
+static size_t mappingCount = 0;
+/** Every CorpusEntry list and name allocated so far */
+static void **allocations = NULL;
+static size_t allocationCount = 0;
+
+/** The entries of the corpus currently being loaded */
+static CorpusEntry *entries = NULL;
+static size_t entryCount = 0;
+/** The length of the directory prefix to strip from entry names */
+static size_t rootLength = 0;
+
+/** Remembers a pointer to be freed by corpusUnload()
+	@returns `ptr`, or NULL after freeing it if that fails
+ */
+static void *keep(void *ptr)
+{
+	void **a = ptr ? realloc(allocations, (allocationCount + 1) * sizeof(void*)) : NULL;
+
+	if(a == NULL)
+	{
+		free(ptr);
+		return NULL;
+	}
+
+	allocations = a;
+	return allocations[allocationCount++] = ptr;
+}
+
+/** Maps a whole file read-only
+	@param len Receives the length of the file
+	@returns The mapping, a static empty region for empty files, or NULL after printing an error message
+ */
+static const void *mapFile(const char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+
+	if(fd < 0 || fstat(fd, &st))
+	{
+		fprintf(stderr, RED_BOLD("Can't read corpus file") " '%s': %s\n", path, strerror(errno));
+
+		if(fd >= 0)
+			close(fd);
+
+		return NULL;
+	}
+
+	*len = st.st_size;
+
+	if(*len == 0)
+	{
+		close(fd);
+		return "";
+	}
+
+	void *addr = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	struct Mapping *m = addr != MAP_FAILED ? realloc(mappings, (mappingCount + 1) * sizeof(struct Mapping)) : NULL;
+
+	if(m == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Can't map corpus file") " '%s': %s\n", path, strerror(errno));
+
+		if(addr != MAP_FAILED)
+			munmap(addr, *len);
+
+		return NULL;
+	}
+
+	mappings = m;
+	mappings[mappingCount++] = (struct Mapping){ addr, *len };
+	return addr;
+}
+
+/** Appends an entry to `entries`
+	@param name Copied
+	@returns false on allocation failure
+ */
+static bool addEntry(const void *ptr, size_t len, const char *name, size_t nameLength)
+{
+	CorpusEntry *e = realloc(entries, (entryCount + 1) * sizeof(CorpusEntry));
+
+	if(e == NULL)
+		return false;
+
+	entries = e;
+	char *n = keep(strndup(name, nameLength));
+
+	if(n == NULL)
+		return false;
+
+	entries[entryCount++] = (CorpusEntry){ .ptr = ptr, .len = len, .name = n };
+	return true;
+}
+
+/** nftw() callback adding every regular file */
+static int addFile(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	(void)st;
+	(void)ftw;
+
+	if(type != FTW_F)
+		return 0;
+
+	size_t len;
+	const void *ptr = mapFile(path, &len);
+
+	if(ptr == NULL)
+		return 1;
+
+	const char *name = path + rootLength;
+	return !addEntry(ptr, len, name, strlen(name));
+}
+
+static int _cmp_entry(const void *_l, const void *_r)
+{
+	const CorpusEntry *l = _l, *r = _r;
+	return strcmp(l->name, r->name);
+}
+
+/** Splits a packed corpus into entries. It consists of PACKED_MAGIC, followed by records of a line "<name>\t<length>" and `length` raw bytes.
+	@returns false and prints an error message if the file is malformed
+ */
+static bool splitPacked(const char *path, const char *data, size_t len)
+{
+	for(size_t pos = strlen(PACKED_MAGIC); pos < len;)
+	{
+		const char *line = data + pos;
+		const char *nl = memchr(line, '\n', len - pos);
+		const char *tab = nl ? memchr(line, '\t', nl - line) : NULL;
+		char *end;
+
+		if(tab == NULL)
+			goto malformed;
+
+		size_t size = strtoull(tab + 1, &end, 10);
+		pos = nl + 1 - data;
+
+		if(end != nl || size > len - pos)
+			goto malformed;
+		if(! addEntry(data + pos, size, line, tab - line))
+		{
+			fprintf(stderr, RED_BOLD("Can't load corpus") " '%s': malloc() failed\n", path);
+			return false;
+		}
+
+		pos += size;
+		continue;
+
+		malformed:
+		fprintf(stderr, RED_BOLD("Malformed packed corpus") " '%s' at offset %zu\n", path, (size_t)(line - data));
+		return false;
+	}
+
+	return true;
+}
+
+size_t formatCorpusEntry(char *to, size_t n, const CorpusEntry *e)
+{
+	return snprintf(to, n, "%s (%zu bytes)", e->name, e->len);
+}
+
+bool corpusLoad(const char *path)
+{
+	struct stat st;
+	entries = NULL;
+	entryCount = 0;
+
+	if(stat(path, &st))
+	{
+		fprintf(stderr, RED_BOLD("Can't load corpus") " '%s': %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if(S_ISDIR(st.st_mode))
+	{
+		rootLength = strlen(path) + (path[strlen(path) - 1] != '/');
+
+		if(nftw(path, addFile, 64, FTW_PHYS))
+		{
+			free(entries);
+			return false;
+		}
+
+		// directory order is arbitrary, but recorded failures refer to entries by index
+		qsort(entries, entryCount, sizeof(CorpusEntry), _cmp_entry);
+	}
+	else
+	{
+		size_t len;
+		const char *data = mapFile(path, &len);
+		const char *base = strrchr(path, '/');
+		base = base ? base + 1 : path;
+
+		if(data == NULL)
+			return false;
+
+		bool ok = (len >= strlen(PACKED_MAGIC) && memcmp(data, PACKED_MAGIC, strlen(PACKED_MAGIC)) == 0)
+			? splitPacked(path, data, len)
+			: addEntry(data, len, base, strlen(base));
+
+		if(! ok)
+		{
+			free(entries);
+			return false;
+		}
+	}
+
+	if(entryCount == 0)
+	{
+		fprintf(stderr, YELLOW("Corpus '%s' contains no files\n"), path);
+		free(entries);
+		return true;
+	}
+
+	struct Provider p = {
+		.dlName = CORPUS_DL,
+		.name = path,
+		.count = entryCount,
+		.data = keep(entries),
+		.format = (format_f)formatCorpusEntry
+	};
+
+	return p.data && registerProvider("CorpusEntry", sizeof(CorpusEntry), &p);
+}
+
+void corpusUnload(void)
+{
+	for(size_t i = 0; i < mappingCount; ++i)
+		munmap(mappings[i].addr, mappings[i].len);
+	for(size_t i = 0; i < allocationCount; ++i)
+		free(allocations[i]);
+
+	free(mappings);
+	free(allocations);
+	mappings = NULL;
+	allocations = NULL;
+	mappingCount = allocationCount = 0;
+}
@@ -0,0 +1,113 @@
+/* --dedup: Drops elements that are byte-wise identical to an earlier element of the same bucket, so that tests don't run equivalent variants repeatedly */
+#include "ccheck.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** FNV-1a over the bytes of an element */
+static uint64_t hashElement(const void *element, size_t size)
+{
+	uint64_t h = 0xcbf29ce484222325u;
+
+	for(const unsigned char *c = element, *end = c + size; c < end; ++c)
+		h = (h ^ *c) * 0x100000001b3u;
+
+	return h;
+}
+
+/** @returns Whether a derived provider takes elements from the provider at `index` in `b`, which must therefore keep its indices */
+static bool isSource(const struct ProviderBucket *b, size_t index)
+{
+	for(const struct ProviderBucket *other = providerRoot; other; other = other->next)
+	{
+		for(size_t i = 0; i < other->count; ++i)
+		{
+			const struct Provider *p = &other->providers[i];
+
+			for(size_t s = 0; s < p->sourceCount; ++s)
+			{
+				if(p->sources[s].bucket == b && p->sources[s].index == index)
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void dedupBucket(struct ProviderBucket *b)
+{
+	if(! options.dedup)
+		return;
+
+	size_t total = 0, cap = 16, removed = 0;
+
+	for(size_t i = 0; i < b->count; ++i)
+		total += b->providers[i].derived ? 0 : b->providers[i].count;
+
+	while(cap < 2 * total)
+		cap *= 2;
+
+	/** Open addressing table of every element kept so far, or NULL */
+	const void **table = calloc(cap, sizeof(void*));
+
+	if(table == NULL)
+	{
+		fprintf(stderr, YELLOW("Not deduplicating provider data of type '%s': malloc() failed\n"), b->type);
+		return;
+	}
+
+	for(size_t i = 0; i < b->count; ++i)
+	{
+		struct Provider *p = &b->providers[i];
+
+		if(p->derived)
+			continue;
+
+		// replicated data has been deduplicated when its bucket completed before, and sources are indexed by derived providers
+		bool fixed = p->replicas || isSource(b, i);
+		char *data = (char*)p->data;
+		size_t kept = 0;
+
+		for(size_t e = 0; e < p->count; ++e)
+		{
+			const char *element = data + e * b->elementSize;
+			size_t slot = hashElement(element, b->elementSize) & (cap - 1);
+
+			while(table[slot] && memcmp(table[slot], element, b->elementSize) != 0)
+				slot = (slot + 1) & (cap - 1);
+
+			// an emptied provider would break the enumeration of variants, so each keeps at least one element
+			bool duplicate = table[slot] != NULL && !fixed && (kept || e + 1 < p->count);
+
+			if(duplicate)
+				continue;
+
+			if(kept != e)
+				memcpy(data + kept * b->elementSize, element, b->elementSize);
+
+			if(table[slot] == NULL)
+				table[slot] = data + kept * b->elementSize;
+
+			++kept;
+		}
+
+		p->duplicates += p->count - kept;
+		removed += p->count - kept;
+		p->count = kept;
+	}
+
+	free(table);
+
+	if(removed && options.verbose)
+		printf("Dropped %zu duplicate %s of type '%s'\n", CONJUGATE(removed, "element"), b->type);
+}
+
+size_t dedupSaved(const struct Test *test)
+{
+	if(! options.dedup)
+		return 0;
+
+	return countVariants(&test->sig, true) - countVariants(&test->sig, false);
+}
@@ -0,0 +1,322 @@
+/* DERIVED_PROVIDER(): Providers whose elements are computed from other providers while tests run.
+	Only filters store anything, namely the indices of the elements they keep.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @returns The description emitted by DERIVED_PROVIDER(), or NULL if the provider is a regular one */
+static const struct DerivedProvider *describe(const struct DL *dl, const char *name)
+{
+	char symbol[strlen(name) + 19];
+	snprintf(symbol, sizeof(symbol), "_DERIVED_PROVIDER_%s", name);
+
+	return dlsym(dl->handle, symbol);
+}
+
+/** Locates a loaded provider by name, preferring one from the given object
+	@param exact Only accept a provider from the given object
+	@param out Receives the provider's location
+	@returns false if no provider of that name is loaded
+ */
+static bool findSource(const char *dlName, const char *name, bool exact, struct ProviderSource *out)
+{
+	bool found = false;
+
+	for(struct ProviderBucket *b = providerRoot; b; b = b->next)
+	{
+		for(size_t i = 0; i < b->count; ++i)
+		{
+			if(strcmp(b->providers[i].name, name) != 0 || (exact && strcmp(b->providers[i].dlName, dlName) != 0))
+				continue;
+
+			*out = (struct ProviderSource){ .bucket = b, .index = i, .dlName = b->providers[i].dlName, .name = b->providers[i].name };
+			found = true;
+
+			if(strcmp(b->providers[i].dlName, dlName) == 0)
+				return true;
+		}
+	}
+
+	return found;
+}
+
+bool isDerived(const struct DL *dl, const char *name)
+{
+	return describe(dl, name) != NULL;
+}
+
+bool deriveReady(const struct DL *dl, const char *name)
+{
+	const struct DerivedProvider *d = describe(dl, name);
+	struct ProviderSource s;
+
+	for(const char *src = d ? d->sources : ""; *src; src += strlen(src) + 1)
+	{
+		if(! findSource(dl->name, src, false, &s))
+			return false;
+	}
+
+	return true;
+}
+
+/** @returns The type of the provider with the given name in any test object, or NULL */
+static const char *deriveSourceType(const char *name)
+{
+	char symbol[strlen(name) + 11];
+	snprintf(symbol, sizeof(symbol), "_PROVIDER_%s", name);
+
+	for(size_t d = 0; d < dlCount; ++d)
+	{
+		const char *type = dls[d].handle ? dlsym(dls[d].handle, symbol) : NULL;
+
+		if(type)
+			return type;
+	}
+
+	return NULL;
+}
+
+const char *deriveMissingType(const struct DL *dl, const char *name, const char *type, size_t typeCount, const char *const types[static typeCount])
+{
+	const struct DerivedProvider *d = describe(dl, name);
+	size_t t = 0;
+
+	while(t < typeCount && strcmp(types[t], type) != 0)
+		++t;
+
+	// nothing is needed from the sources of unused providers
+	if(d == NULL || t == typeCount)
+		return NULL;
+
+	for(const char *src = d->sources; *src; src += strlen(src) + 1)
+	{
+		const char *st = deriveSourceType(src);
+
+		for(t = 0; st && t < typeCount && strcmp(types[t], st) != 0; ++t);
+
+		if(st && t == typeCount)
+			return st;
+	}
+
+	return NULL;
+}
+
+size_t scratchWords(unsigned count, struct ProviderBucket *const buckets[static count])
+{
+	size_t size = 1;
+
+	for(unsigned i = 0; i < count; ++i)
+	{
+		if(buckets[i] && buckets[i]->elementSize > size)
+			size = buckets[i]->elementSize;
+	}
+
+	return SCRATCH_WORDS(size);
+}
+
+/** @returns The number of elements of a source */
+static inline size_t sourceCount(const struct ProviderSource *s)
+{
+	return s->bucket->providers[s->index].count;
+}
+
+const void *deriveArg(const struct Provider *p, size_t dataPosition, void *scratch)
+{
+	const struct ProviderSource *s = p->sources;
+
+	switch(p->derived->op)
+	{
+		case DERIVE_FILTER:
+			return locateArg(s[0].bucket, s[0].index, ((const size_t*)p->data)[dataPosition], scratch);
+
+		case DERIVE_CONCAT:
+			for(size_t i = 0;; ++i)
+			{
+				if(dataPosition < sourceCount(&s[i]))
+					return locateArg(s[i].bucket, s[i].index, dataPosition, scratch);
+
+				dataPosition -= sourceCount(&s[i]);
+			}
+
+		case DERIVE_MAP:
+		{
+			scratch_t in[SCRATCH_WORDS(s[0].bucket->elementSize)];
+			((void (*)(const void*, void*))p->derived->func)(locateArg(s[0].bucket, s[0].index, dataPosition, in), scratch);
+			return scratch;
+		}
+
+		case DERIVE_ZIP:
+		{
+			scratch_t a[SCRATCH_WORDS(s[0].bucket->elementSize)], b[SCRATCH_WORDS(s[1].bucket->elementSize)];
+			((void (*)(const void*, const void*, void*))p->derived->func)(
+				locateArg(s[0].bucket, s[0].index, dataPosition, a), locateArg(s[1].bucket, s[1].index, dataPosition, b), scratch);
+			return scratch;
+		}
+	}
+
+	return NULL;
+}
+
+/** Computes the indices kept by a filter
+	@returns A malloc()ed list of indices, or NULL after printing an error message
+ */
+static size_t *runFilter(const struct DL *dl, const char *name, const struct DerivedProvider *d, const struct ProviderSource *s, size_t *count)
+{
+	size_t n = sourceCount(s), *kept = malloc((n ? n : 1) * sizeof(size_t));
+	scratch_t scratch[SCRATCH_WORDS(s->bucket->elementSize)];
+	bool (*pred)(const void*) = (bool (*)(const void*))d->func;
+
+	if(kept == NULL)
+	{
+		fprintf(stderr, YELLOW("Failed to load provider %s::%s: Malloc failure\n"), dl->name, name);
+		return NULL;
+	}
+
+	*count = 0;
+
+	if(setjmp(runningTest.failTarget))
+	{
+		runningTest.jumpReady = false;
+		fprintf(stderr, RED("Failed to run provider %s::%s: %s\n"), dl->name, name, runningTest.message);
+		free(kept);
+		return NULL;
+	}
+
+	runningTest.jumpReady = true;
+
+	for(size_t i = 0; i < n; ++i)
+	{
+		if(pred(locateArg(s->bucket, s->index, i, scratch)))
+			kept[(*count)++] = i;
+	}
+
+	runningTest.jumpReady = false;
+	return kept;
+}
+
+bool deriveProvider(struct DL *dl, const char *name, const char *type, size_t size, format_f format)
+{
+	const struct DerivedProvider *d = describe(dl, name);
+	size_t sourceTotal = 0;
+
+	for(const char *src = d->sources; *src; src += strlen(src) + 1)
+		++sourceTotal;
+
+	struct ProviderSource *sources = calloc(sourceTotal ? sourceTotal : 1, sizeof(struct ProviderSource));
+	struct Provider p = { .dlName = dl->name, .name = name, .derived = d, .sources = sources, .sourceCount = sourceTotal };
+	const char *src = d->sources, *problem = NULL;
+
+	if(sources == NULL)
+	{
+		fprintf(stderr, YELLOW("Failed to load provider %s::%s: Malloc failure\n"), dl->name, name);
+		return false;
+	}
+
+	for(size_t i = 0; i < sourceTotal; ++i, src += strlen(src) + 1)
+	{
+		if(! findSource(dl->name, src, false, &sources[i]))
+		{
+			fprintf(stderr, YELLOW("Failed to load provider %s::%s: Unknown source provider '%s'\n"), dl->name, name, src);
+			free(sources);
+			return false;
+		}
+
+		// filters and concatenations pass on the elements of their sources, so the types must agree
+		if((d->op == DERIVE_FILTER || d->op == DERIVE_CONCAT) && strcmp(sources[i].bucket->type, type) != 0)
+			problem = "Source type differs";
+	}
+
+	// any loaded provider of the same type knows how to format it
+	struct ProviderBucket *same = findProvider(type);
+
+	if(format == NULL && same && same->count)
+		format = same->providers[0].format;
+
+	if(format == NULL)
+		problem = "No formatter for its type is loaded";
+	else if(d->op > DERIVE_CONCAT)
+		problem = "Unknown derivation";
+	else if(sourceTotal != (d->op == DERIVE_ZIP ? 2u : 1u) && d->op != DERIVE_CONCAT)
+		problem = d->op == DERIVE_ZIP ? "Expected 2 sources" : "Expected 1 source";
+	else if(sourceTotal == 0)
+		problem = "Expected at least 1 source";
+	else if(d->func == NULL && d->op != DERIVE_CONCAT)
+		problem = "Missing function";
+
+	if(problem)
+	{
+		fprintf(stderr, YELLOW("Failed to load provider %s::%s: %s\n"), dl->name, name, problem);
+		free(sources);
+		return false;
+	}
+
+	p.format = format;
+
+	switch(d->op)
+	{
+		case DERIVE_MAP:
+			p.count = sourceCount(&sources[0]);
+		break;
+
+		case DERIVE_FILTER:
+			if((p.data = runFilter(dl, name, d, &sources[0], &p.count)) == NULL)
+			{
+				free(sources);
+				return false;
+			}
+		break;
+
+		case DERIVE_ZIP:
+			p.count = sourceCount(&sources[0]) < sourceCount(&sources[1]) ? sourceCount(&sources[0]) : sourceCount(&sources[1]);
+		break;
+
+		case DERIVE_CONCAT:
+			for(size_t i = 0; i < sourceTotal; ++i)
+				p.count += sourceCount(&sources[i]);
+		break;
+	}
+
+	if(! registerProvider(type, size, &p))
+	{
+		free((void*)p.data);
+		free(sources);
+		return false;
+	}
+
+	return true;
+}
+
+void deriveRelink(void)
+{
+	for(bool removed = true; removed;)
+	{
+		removed = false;
+
+		for(struct ProviderBucket *b = providerRoot; b; b = b->next)
+		{
+			for(size_t i = 0; i < b->count; ++i)
+			{
+				struct Provider *p = &b->providers[i];
+				bool ok = true;
+
+				for(size_t s = 0; ok && s < p->sourceCount; ++s)
+					ok = findSource(p->sources[s].dlName, p->sources[s].name, true, &p->sources[s]);
+
+				if(ok)
+					continue;
+
+				// its source was unloaded, and a later planProviders() reloads it along with its object's other providers
+				free((void*)p->data);
+				free(p->sources);
+				memmove(p, p + 1, (b->count - i - 1) * sizeof(struct Provider));
+				--b->count;
+				--i;
+				removed = true;
+			}
+		}
+	}
+}
@@ -0,0 +1,177 @@
+/* Fixtures: State shared by the variants of TEST_WITH() tests.
+	Each runner thread sets up a fixture the first time one of an object's tests uses it, and tears it down once that object's tests finished.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** A hook defined via FIXTURE_SETUP(), FIXTURE_TEARDOWN() or FIXTURE_RESET() */
+typedef void (*fixture_f)(void *fixture);
+
+/** A fixture set up by the calling thread */
+struct FixtureInstance
+{
+	const struct DL *dl;
+	/** The name given to FIXTURE(), pointing into the object */
+	const char *name;
+	fixture_f teardown, reset;
+	/** The zeroed memory passed to the hooks */
+	void *data;
+	/** Set once a variant failed, which may have left the fixture in any state */
+	bool broken;
+	/** Whether no variant ran since the setup, which makes a reset unnecessary */
+	bool fresh;
+	struct FixtureInstance *next;
+};
+
+/** Every fixture set up by the calling thread */
+static __thread struct FixtureInstance *instances = NULL;
+
+/** @returns A hook of a fixture, or NULL if it isn't defined */
+static fixture_f findHook(const struct DL *dl, const char *kind, const char *name)
+{
+	char symbol[strlen(kind) + strlen(name) + 12];
+	snprintf(symbol, sizeof(symbol), "_FIXTURE_%s_%s", kind, name);
+	return (fixture_f)(size_t)dlsym(dl->handle, symbol);
+}
+
+/** Runs a hook like a variant, so that failures and crashes in it are caught
+	@returns false, with the reason in `runningTest.message`, if it failed
+ */
+static bool runHook(fixture_f hook, void *data)
+{
+	const void *args[] = { data };
+	// hooks must not be reset or broken like the variants using the fixture
+	runningTest.fixture = NULL;
+	return runVariant((test_f)hook, 1, args);
+}
+
+/** Tears down a fixture and frees it */
+static void destroy(struct FixtureInstance *f)
+{
+	if(f->teardown && !runHook(f->teardown, f->data))
+		fprintf(stderr, YELLOW("Failed to tear down fixture %s of %s: %s\n"), f->name, f->dl->name, runningTest.message);
+
+	free(f->data);
+	free(f);
+}
+
+bool fixtureEnter(const struct DL *dl, const struct Test *test)
+{
+	runningTest.fixture = NULL;
+
+	if(test->fixture == NULL)
+		return true;
+
+	struct FixtureInstance **link = &instances;
+
+	while(*link && ((*link)->dl != dl || strcmp((*link)->name, test->fixture) != 0))
+		link = &(*link)->next;
+
+	// a variant that failed may have left it half-modified
+	if(*link && (*link)->broken)
+	{
+		struct FixtureInstance *f = *link;
+		*link = f->next;
+		destroy(f);
+	}
+	else if(*link)
+	{
+		runningTest.fixture = *link;
+		return true;
+	}
+
+	char sizeName[strlen(test->fixture) + 17];
+	snprintf(sizeName, sizeof(sizeName), "_SIZEOF_FIXTURE_%s", test->fixture);
+	const size_t *size = dlsym(dl->handle, sizeName);
+	fixture_f setup = findHook(dl, "SETUP", test->fixture);
+
+	if(size == NULL || setup == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: Fixture %s has no FIXTURE_SETUP()\n", dl->name, test->name, test->fixture);
+		return false;
+	}
+
+	struct FixtureInstance *f = malloc(sizeof(struct FixtureInstance));
+	void *data = calloc(1, *size ? *size : 1);
+
+	if(f == NULL || data == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Couldn't run test") " %s::%s: malloc() failed for fixture %s\n", dl->name, test->name, test->fixture);
+		free(f);
+		free(data);
+		return false;
+	}
+
+	*f = (struct FixtureInstance){
+		.dl = dl,
+		.name = test->fixture,
+		.teardown = findHook(dl, "TEARDOWN", test->fixture),
+		.reset = findHook(dl, "RESET", test->fixture),
+		.data = data,
+		.fresh = true,
+		.next = instances
+	};
+
+	if(! runHook(setup, data))
+	{
+		flockfile(stdout);
+		printf(RED_BOLD("Failed to set up") " fixture %s for %s::%s: %s\n", test->fixture, dl->name, test->name, runningTest.message);
+		capturePrint();
+		funlockfile(stdout);
+
+		// whatever the setup acquired before failing is released, if the teardown copes with that
+		f->next = NULL;
+		destroy(f);
+		return false;
+	}
+
+	instances = f;
+	runningTest.fixture = f;
+	return true;
+}
+
+void fixtureReset(void)
+{
+	struct FixtureInstance *f = runningTest.fixture;
+
+	if(f == NULL)
+		return;
+	if(f->reset && !f->fresh)
+		f->reset(f->data);
+
+	f->fresh = false;
+}
+
+void fixtureBreak(void)
+{
+	if(runningTest.fixture)
+		runningTest.fixture->broken = true;
+}
+
+void fixtureRelease(const struct DL *dl)
+{
+	runningTest.fixture = NULL;
+
+	for(struct FixtureInstance **link = &instances; *link;)
+	{
+		struct FixtureInstance *f = *link;
+
+		if(dl && f->dl != dl)
+		{
+			link = &f->next;
+			continue;
+		}
+
+		*link = f->next;
+		destroy(f);
+	}
+}
+
+void *testFixture(void)
+{
+	return runningTest.fixture ? runningTest.fixture->data : NULL;
+}
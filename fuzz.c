@@ -0,0 +1,631 @@
+/* Coverage-guided fuzzing of TEST() functions, seeded from provider data.
+	Coverage comes from subjects built with `-fsanitize-coverage=trace-pc-guard` (clang) or `-fsanitize-coverage=trace-pc` (gcc),
+	whose callbacks are implemented here and exported to them like the exit() hook.
+*/
+#include "ccheck.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Number of slots in a coverage map. Guards beyond that share slots. */
+#define MAP_SIZE (1 << 16)
+/** Number of inputs drawn from provider data to seed each target */
+#define SEED_COUNT 256
+/** Maximum number of inputs kept per target */
+#define MAX_CORPUS 4096
+/** Number of executions a worker performs on one target before moving on to the next */
+#define BATCH_SIZE 512
+/** Alignment of every argument within an input */
+#define ARG_ALIGN 16
+
+/** The coverage of a single execution */
+struct Trace
+{
+	/** Saturating hit count, indexed by guard */
+	uint8_t hits[MAP_SIZE];
+	/** Every guard with a nonzero hit count, in order of first hit */
+	uint32_t touched[MAP_SIZE];
+	/** Length of `touched` */
+	size_t touchedCount;
+};
+
+/** A test object being fuzzed. Its tests share the object's state, so only THREADSAFE_TEST()s run concurrently, as under `--stress`. */
+struct Module
+{
+	const struct DL *dl;
+	/** Held shared while fuzzing a THREADSAFE_TEST(), and exclusively while fuzzing any other test */
+	pthread_rwlock_t lock;
+	/** Whether any of its targets is a THREADSAFE_TEST() */
+	bool threadsafe;
+	/** Set while a worker waits to hold `lock` exclusively, after which THREADSAFE_TEST()s don't take it anymore, so that they can't starve other tests */
+	bool exclusiveWanted;
+	struct Module *next;
+};
+
+/** A test being fuzzed */
+struct Target
+{
+	struct DL *dl;
+	struct Module *module;
+	struct Test test;
+	/** [0 ; arity) -> bucket the argument's type is provided by */
+	struct ProviderBucket *buckets[MAX_ARITY];
+	/** [0 ; arity) -> whether the argument's type holds pointers, which are only ever replaced by whole elements */
+	bool pointers[MAX_ARITY];
+	/** [0 ; arity) -> offset of the argument within an input */
+	size_t offsets[MAX_ARITY];
+	/** The length of one input */
+	size_t inputSize;
+
+	/** Guards `corpus`, `corpusCount` and writes to `seen` */
+	pthread_mutex_t lock;
+	/** `corpusCount` inputs that reached new coverage, each `inputSize` bytes */
+	uint8_t *corpus;
+	size_t corpusCount;
+	/** Bit mask of hit count classes observed so far, indexed by guard */
+	uint8_t seen[MAP_SIZE];
+
+	/** Number of executions so far */
+	size_t execs;
+	/** Set once a crashing input was found, after which the target isn't fuzzed any further */
+	bool crashed;
+
+	struct Target *next;
+};
+
+/** The trace of the currently running fuzzer input, or NULL outside of fuzzing */
+static __thread struct Trace *trace = NULL;
+/** Number of guards handed out to instrumented objects */
+static uint32_t guardCount = 0;
+
+/** Guards `targets`, `targetCount` and `modules` */
+static pthread_mutex_t targetsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct Target *targets = NULL;
+static size_t targetCount = 0;
+static struct Module *modules = NULL;
+/** CLOCK_MONOTONIC time at which fuzzing stops */
+static double deadline;
+
+void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop)
+{
+	if(start == stop || *start)
+		return;
+
+	for(uint32_t *g = start; g < stop; ++g)
+		*g = __atomic_add_fetch(&guardCount, 1, __ATOMIC_RELAXED) % (MAP_SIZE - 1) + 1;
+}
+
+void __sanitizer_cov_trace_pc_guard(uint32_t *guard)
+{
+	struct Trace *t = trace;
+
+	if(t == NULL)
+		return;
+
+	uint32_t g = *guard;
+
+	if(t->hits[g] == 0)
+		t->touched[t->touchedCount++] = g;
+	if(t->hits[g] != UINT8_MAX)
+		++t->hits[g];
+}
+
+/** Called on every basic block by code compiled with gcc's `-fsanitize-coverage=trace-pc`.
+	Since there are no guards, slots are chosen by hashing the return address.
+ */
+void __sanitizer_cov_trace_pc(void)
+{
+	struct Trace *t = trace;
+
+	if(t == NULL)
+		return;
+
+	uint64_t pc = (uintptr_t)__builtin_return_address(0);
+	uint32_t g = (pc * 0x9E3779B97F4A7C15ULL) >> 48;
+
+	if(g == 0)
+		g = 1;
+	if(t->hits[g] == 0)
+		t->touched[t->touchedCount++] = g;
+	if(t->hits[g] != UINT8_MAX)
+		++t->hits[g];
+}
+
+/** Groups hit counts into power-of-two classes, like AFL does
+	@returns A single bit identifying the class of `hits`
+ */
+static uint8_t hitClass(uint8_t hits)
+{
+	if(hits <= 2)
+		return hits;
+	if(hits == 3)
+		return 4;
+	if(hits < 8)
+		return 8;
+	if(hits < 16)
+		return 16;
+	if(hits < 32)
+		return 32;
+	if(hits < 128)
+		return 64;
+
+	return 128;
+}
+
+/** xorshift64* */
+static uint64_t next(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/** @returns A uniformly distributed number in [0 ; n) */
+static size_t below(uint64_t *rng, size_t n)
+{
+	return next(rng) % n;
+}
+
+/** Copies a random element of the given bucket to `to` */
+static void randomElement(const struct ProviderBucket *pb, uint64_t *rng, void *to)
+{
+	const struct Provider *p = &pb->providers[below(rng, pb->count)];
+
+	if(p->count)
+	{
+		size_t i = p - pb->providers;
+		const void *from = locateArg((struct ProviderBucket*)pb, i, below(rng, p->count), to);
+
+		if(from != to)
+			memcpy(to, from, pb->elementSize);
+	}
+}
+
+void fuzzAddTarget(struct DL *dl, const struct Test *test)
+{
+	struct Target *t = calloc(1, sizeof(struct Target));
+
+	if(t == NULL)
+		return;
+
+	t->dl = dl;
+	t->test = *test;
+
+	for(unsigned int i = 0; i < test->sig.arity; ++i)
+	{
+		t->buckets[i] = findProvider(test->sig.argTypes[test->sig.argTypeIndices[i]]);
+
+		for(size_t p = 0; !t->pointers[i] && p < t->buckets[i]->count; ++p)
+			t->pointers[i] = holdsPointers(t->buckets[i], p);
+
+		t->offsets[i] = t->inputSize;
+		t->inputSize += (t->buckets[i]->elementSize + ARG_ALIGN - 1) / ARG_ALIGN * ARG_ALIGN;
+	}
+
+	t->corpus = malloc(SEED_COUNT * t->inputSize);
+
+	if(t->corpus == NULL)
+	{
+		free(t);
+		return;
+	}
+
+	uint64_t rng = (size_t)t | 1;
+
+	for(; t->corpusCount < SEED_COUNT; ++t->corpusCount)
+	{
+		for(unsigned int i = 0; i < test->sig.arity; ++i)
+			randomElement(t->buckets[i], &rng, t->corpus + t->corpusCount * t->inputSize + t->offsets[i]);
+	}
+
+	pthread_mutex_init(&t->lock, NULL);
+
+	pthread_mutex_lock(&targetsLock);
+
+	t->module = modules;
+
+	while(t->module && t->module->dl != dl)
+		t->module = t->module->next;
+
+	if(t->module == NULL && (t->module = calloc(1, sizeof(struct Module))))
+	{
+		t->module->dl = dl;
+		pthread_rwlock_init(&t->module->lock, NULL);
+		t->module->next = modules;
+		modules = t->module;
+	}
+
+	if(t->module == NULL)
+	{
+		pthread_mutex_unlock(&targetsLock);
+		pthread_mutex_destroy(&t->lock);
+		free(t->corpus);
+		free(t);
+		return;
+	}
+
+	t->module->threadsafe |= test->threadsafe;
+	t->next = targets;
+	targets = t;
+	++targetCount;
+	pthread_mutex_unlock(&targetsLock);
+}
+
+/** Applies a random byte-level mutation to a single argument of an input.
+	Arguments holding pointers are replaced by other elements instead, since flipping bits in a pointer only finds crashes of the fuzzer's making.
+ */
+static void mutate(const struct Target *t, uint8_t *input, uint64_t *rng)
+{
+	unsigned int arg = below(rng, t->test.sig.arity);
+	const struct ProviderBucket *pb = t->buckets[arg];
+	size_t size = pb->elementSize;
+	uint8_t *at = input + t->offsets[arg];
+
+	static const int64_t interesting[] = { 0, 1, -1, 2, 16, 32, 64, 100, 127, 128, 255, 256, 1024, 4096, 32767, 32768, 65535, 65536, INT32_MAX, INT32_MIN, INT64_MAX, INT64_MIN };
+
+	switch(t->pointers[arg] ? 4 + below(rng, 2) : below(rng, 6))
+	{
+		case 0:
+			at[below(rng, size)] ^= 1 << below(rng, 8);
+		break;
+
+		case 1:
+			at[below(rng, size)] = next(rng);
+		break;
+
+		// arithmetic on a little-endian word that fits into the element
+		case 2:
+		case 3:
+		{
+			size_t width = 1;
+
+			while(width < 8 && width * 2 <= size && below(rng, 2))
+				width *= 2;
+
+			size_t off = below(rng, size - width + 1);
+			uint64_t v = 0;
+			memcpy(&v, at + off, width);
+
+			if(below(rng, 2))
+				v = interesting[below(rng, sizeof(interesting) / sizeof(*interesting))];
+			else
+				v += below(rng, 2) ? 1 + below(rng, 35) : -(1 + below(rng, 35));
+
+			memcpy(at + off, &v, width);
+		}
+		break;
+
+		// replace with a value straight from a provider
+		case 4:
+			randomElement(pb, rng, at);
+		break;
+
+		// splice the argument from another corpus entry
+		case 5:
+			memcpy(at, t->corpus + below(rng, t->corpusCount) * t->inputSize + t->offsets[arg], size);
+		break;
+	}
+}
+
+/** Writes a crashing input to disk, as the concatenation of every argument value
+	@param path Receives the file name
+	@returns false on failure
+ */
+static bool saveCrash(const struct Target *t, const uint8_t *input, char path[static PATH_MAX])
+{
+	if(mkdir(options.fuzzDir, 0777) && errno != EEXIST)
+	{
+		fprintf(stderr, YELLOW("Couldn't save crashing input: mkdir(%s): %s\n"), options.fuzzDir, strerror(errno));
+		return false;
+	}
+
+	const char *base = strrchr(t->dl->name, '/');
+	snprintf(path, PATH_MAX, "%s/%s-%s.bin", options.fuzzDir, base ? base + 1 : t->dl->name, t->test.name);
+	FILE *f = fopen(path, "wb");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't save crashing input: fopen(%s): %s\n"), path, strerror(errno));
+		return false;
+	}
+
+	for(unsigned int i = 0; i < t->test.sig.arity; ++i)
+		fwrite(input + t->offsets[i], t->buckets[i]->elementSize, 1, f);
+
+	fclose(f);
+	return true;
+}
+
+/** Reports a crashing input, unless another worker already did so for the same target */
+static void reportCrash(struct Target *t, const uint8_t *input, const void *const args[])
+{
+	if(__atomic_exchange_n(&t->crashed, true, __ATOMIC_RELAXED))
+		return;
+
+	format_f formats[MAX_ARITY];
+	const char *origins[MAX_ARITY];
+
+	for(unsigned int i = 0; i < t->test.sig.arity; ++i)
+	{
+		formats[i] = t->buckets[i]->providers[0].format;
+		origins[i] = "fuzzed";
+	}
+
+	printFailure(t->dl, &t->test, formats, args, origins);
+
+	char path[PATH_MAX];
+
+	if(saveCrash(t, input, path))
+		printf("  Crashing input for %s::%s written to %s\n", t->dl->name, t->test.name, path);
+}
+
+/** Checks whether a trace reached coverage not seen before and clears it
+	@param add Whether to merge the new coverage into `t->seen`
+	@returns true if there was new coverage
+ */
+static bool newCoverage(struct Target *t, struct Trace *tr, bool add)
+{
+	bool found = false;
+
+	for(size_t i = 0; i < tr->touchedCount; ++i)
+	{
+		uint32_t g = tr->touched[i];
+		uint8_t c = hitClass(tr->hits[g]);
+
+		if((__atomic_load_n(&t->seen[g], __ATOMIC_RELAXED) & c) != c)
+		{
+			found = true;
+
+			if(add)
+				__atomic_fetch_or(&t->seen[g], c, __ATOMIC_RELAXED);
+		}
+	}
+
+	return found;
+}
+
+/** Clears a trace for the next execution */
+static void resetTrace(struct Trace *tr)
+{
+	for(size_t i = 0; i < tr->touchedCount; ++i)
+		tr->hits[tr->touched[i]] = 0;
+
+	tr->touchedCount = 0;
+}
+
+/** Fuzzer thread entry point
+	@param _targets NULL-terminated array of every target
+	@returns NULL
+ */
+static void *fuzzWorker(void *_targets)
+{
+	struct Target **all = _targets;
+	struct Trace *tr = calloc(1, sizeof(struct Trace));
+	size_t maxInput = 0;
+
+	for(size_t i = 0; i < targetCount; ++i)
+	{
+		if(all[i]->inputSize > maxInput)
+			maxInput = all[i]->inputSize;
+	}
+
+	uint8_t *input = aligned_alloc(ARG_ALIGN, maxInput);
+	uint64_t rng;
+
+	if(tr == NULL || input == NULL || getrandom(&rng, sizeof(rng), 0) != sizeof(rng))
+	{
+		fprintf(stderr, YELLOW("Fuzzer thread failed to initialize\n"));
+		free(tr);
+		free(input);
+		return NULL;
+	}
+
+	rng |= 1;
+	// the number of targets in a row whose object was busy
+	size_t blocked = 0;
+
+	for(size_t round = below(&rng, targetCount);; ++round)
+	{
+		size_t live = 0;
+
+		for(size_t i = 0; i < targetCount; ++i)
+			live += ! __atomic_load_n(&all[i]->crashed, __ATOMIC_RELAXED);
+
+		if(live == 0 || now() >= deadline)
+			break;
+
+		struct Target *t = all[round % targetCount];
+		size_t execs = 0;
+
+		if(__atomic_load_n(&t->crashed, __ATOMIC_RELAXED))
+			continue;
+
+		struct Module *m = t->module;
+		int e;
+
+		if(t->test.threadsafe)
+			e = __atomic_load_n(&m->exclusiveWanted, __ATOMIC_RELAXED) ? EBUSY : pthread_rwlock_tryrdlock(&m->lock);
+		else
+		{
+			e = pthread_rwlock_trywrlock(&m->lock);
+			__atomic_store_n(&m->exclusiveWanted, e != 0, __ATOMIC_RELAXED);
+		}
+
+		// other workers fuzz every object that is left, so wait for one of them to move on
+		if(e)
+		{
+			if(++blocked >= targetCount)
+			{
+				usleep(1000);
+				blocked = 0;
+			}
+
+			continue;
+		}
+
+		blocked = 0;
+
+		// counts as a crash, since the fixture was set up fine during the regular run
+		if(! fixtureEnter(t->dl, &t->test))
+		{
+			__atomic_store_n(&t->crashed, true, __ATOMIC_RELAXED);
+			pthread_rwlock_unlock(&m->lock);
+			continue;
+		}
+
+		while(execs < BATCH_SIZE && !__atomic_load_n(&t->crashed, __ATOMIC_RELAXED))
+		{
+			if(execs % 32 == 0 && now() >= deadline)
+				break;
+
+			pthread_mutex_lock(&t->lock);
+			memcpy(input, t->corpus + below(&rng, t->corpusCount) * t->inputSize, t->inputSize);
+
+			for(size_t n = 1 + below(&rng, 4); n; --n)
+				mutate(t, input, &rng);
+
+			pthread_mutex_unlock(&t->lock);
+
+			const void *args[MAX_ARITY];
+
+			for(unsigned int i = 0; i < t->test.sig.arity; ++i)
+				args[i] = input + t->offsets[i];
+
+			trace = tr;
+			bool ok = runVariant(t->test.func, t->test.sig.arity, args);
+			trace = NULL;
+			++execs;
+
+			if(! ok)
+			{
+				reportCrash(t, input, args);
+				resetTrace(tr);
+				break;
+			}
+
+			if(newCoverage(t, tr, false))
+			{
+				pthread_mutex_lock(&t->lock);
+
+				if(newCoverage(t, tr, true) && t->corpusCount < MAX_CORPUS)
+				{
+					uint8_t *c = realloc(t->corpus, (t->corpusCount + 1) * t->inputSize);
+
+					if(c)
+					{
+						memcpy(c + t->corpusCount++ * t->inputSize, input, t->inputSize);
+						t->corpus = c;
+					}
+				}
+
+				pthread_mutex_unlock(&t->lock);
+			}
+
+			resetTrace(tr);
+		}
+
+		pthread_rwlock_unlock(&m->lock);
+		__atomic_add_fetch(&t->execs, execs, __ATOMIC_RELAXED);
+	}
+
+	free(input);
+	free(tr);
+	fixtureRelease(NULL);
+	captureThreadClose();
+	return NULL;
+}
+
+size_t fuzzRun(void)
+{
+	if(targetCount == 0)
+	{
+		puts(YELLOW("Fuzzing: No passing tests with arguments to fuzz"));
+		return 0;
+	}
+
+	struct Target *all[targetCount];
+	size_t i = 0;
+
+	for(struct Target *t = targets; t; t = t->next)
+		all[i++] = t;
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workerCount = cores > 0 ? cores : 1, parallel = 0;
+
+	// more workers than objects could only run at once would just wait for each other
+	for(const struct Module *m = modules; m; m = m->next)
+		parallel += m->threadsafe ? workerCount : 1;
+
+	if(parallel < workerCount)
+		workerCount = parallel;
+	pthread_t workers[workerCount];
+	bool started[workerCount];
+
+	double start = now();
+	deadline = start + options.fuzzDuration;
+
+	for(size_t w = 0; w < workerCount; ++w)
+	{
+		int e = pthread_create(&workers[w], NULL, fuzzWorker, all);
+
+		if(!(started[w] = !e))
+			fprintf(stderr, YELLOW("Failed to start fuzzer thread: pthread_create(): %s\n"), strerror(e));
+	}
+
+	for(size_t w = 0; w < workerCount; ++w)
+	{
+		if(started[w])
+			pthread_join(workers[w], NULL);
+	}
+
+	double elapsed = now() - start;
+	size_t crashes = 0, execs = 0, totalEdges = 0;
+
+	for(struct Target *t = targets, *next; t; t = next)
+	{
+		size_t edges = 0;
+
+		for(size_t g = 0; g < MAP_SIZE; ++g)
+			edges += t->seen[g] != 0;
+
+		printf("Fuzzed %s::%s: %zu %s, %zu corpus %s, %zu %s\n", t->dl->name, t->test.name,
+			CONJUGATE(t->execs, "execution"), CONJUGATE3(t->corpusCount, "entry", "entries"), CONJUGATE(edges, "edge"));
+
+		crashes += t->crashed;
+		execs += t->execs;
+		totalEdges += edges;
+
+		next = t->next;
+		pthread_mutex_destroy(&t->lock);
+		free(t->corpus);
+		free(t);
+	}
+
+	for(struct Module *m = modules, *next; m; m = next)
+	{
+		next = m->next;
+		pthread_rwlock_destroy(&m->lock);
+		free(m);
+	}
+
+	targets = NULL;
+	targetCount = 0;
+	modules = NULL;
+
+	if(totalEdges == 0)
+		puts(YELLOW("Fuzzing had no coverage feedback: Compile subjects with -fsanitize-coverage=trace-pc-guard or -fsanitize-coverage=trace-pc"));
+
+	printf("Fuzzing: %zu %s in %.1fs (%.0f/s) on %zu %s,\x1B[%u;1m %zu crashing %s\x1B[0m\n",
+		CONJUGATE(execs, "execution"), elapsed, execs / elapsed, CONJUGATE(workerCount, "thread"),
+		crashes ? 31 : 92, CONJUGATE(crashes, "input"));
+
+	return crashes;
+}
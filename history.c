@@ -0,0 +1,219 @@
+/* Durations of modules and tests from previous runs, used to schedule long-running modules first */
+#include "ccheck.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** Assumed time per variant in seconds while no history exists */
+#define DEFAULT_VARIANT_TIME 1e-6
+/** The weight of a new measurement against the recorded duration, to smooth out noise between runs */
+#define SMOOTHING 0.5
+
+/** The recorded duration of a test or module.
+	Stored as one line of tab-separated fields: the module, the test (empty for the module itself), the number of variants and the time in seconds.
+ */
+struct Timing
+{
+	/** malloc()ed path of the test object, as given on the command line */
+	char *module;
+	/** malloc()ed test name, or NULL for the entry of the whole module */
+	char *test;
+	size_t variants;
+	double seconds;
+};
+
+/** Guards `timings` and `timingCount` */
+static pthread_mutex_t timingsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct Timing *timings = NULL;
+static size_t timingCount = 0;
+
+/** Locates an entry
+	@param test The test name, or NULL for the module's own entry
+	@returns NULL if there is none
+ */
+static struct Timing *findTiming(const char *module, const char *test)
+{
+	for(size_t i = 0; i < timingCount; ++i)
+	{
+		if(strcmp(timings[i].module, module) == 0 && (test && timings[i].test ? strcmp(timings[i].test, test) == 0 : test == timings[i].test))
+			return &timings[i];
+	}
+
+	return NULL;
+}
+
+/** Updates or adds an entry. Must be called with `timingsLock` held. */
+static void record(const char *module, const char *test, size_t variants, double seconds)
+{
+	struct Timing *t = findTiming(module, test);
+
+	if(t)
+	{
+		t->variants = variants;
+		t->seconds = SMOOTHING * seconds + (1 - SMOOTHING) * t->seconds;
+		return;
+	}
+
+	struct Timing *r = realloc(timings, (timingCount + 1) * sizeof(struct Timing));
+
+	if(r == NULL)
+		return;
+
+	timings = r;
+	t = &timings[timingCount];
+	*t = (struct Timing){ .module = strdup(module), .test = test ? strdup(test) : NULL, .variants = variants, .seconds = seconds };
+
+	if(t->module == NULL || (test && t->test == NULL))
+	{
+		free(t->module);
+		free(t->test);
+		return;
+	}
+
+	++timingCount;
+}
+
+void historyLoad(void)
+{
+	if(options.historyFile == NULL)
+		return;
+
+	FILE *f = fopen(options.historyFile, "r");
+
+	if(f == NULL)
+	{
+		if(errno != ENOENT)
+			fprintf(stderr, YELLOW("Couldn't read the duration history: fopen(%s): %s\n"), options.historyFile, strerror(errno));
+
+		return;
+	}
+
+	char *line = NULL;
+	size_t cap = 0;
+
+	while(getline(&line, &cap, f) > 0)
+	{
+		char *test = strchr(line, '\t');
+		char *variants = test ? strchr(test + 1, '\t') : NULL;
+		char *seconds = variants ? strchr(variants + 1, '\t') : NULL;
+		char *end;
+
+		if(seconds == NULL)
+			goto malformed;
+
+		*test++ = *variants++ = *seconds++ = 0;
+		size_t v = strtoull(variants, &end, 10);
+
+		if(end == variants || *end)
+			goto malformed;
+
+		double s = strtod(seconds, &end);
+
+		if(end == seconds || (*end && *end != '\n') || s < 0)
+			goto malformed;
+
+		record(line, *test ? test : NULL, v, s);
+		continue;
+
+		malformed:
+		fprintf(stderr, YELLOW("Ignoring malformed entry in '%s'\n"), options.historyFile);
+	}
+
+	free(line);
+	fclose(f);
+}
+
+/** @returns The average time per variant over every recorded test */
+static double variantTime(void)
+{
+	size_t variants = 0;
+	double seconds = 0;
+
+	for(size_t i = 0; i < timingCount; ++i)
+	{
+		if(timings[i].test)
+		{
+			variants += timings[i].variants;
+			seconds += timings[i].seconds;
+		}
+	}
+
+	return variants ? seconds / variants : DEFAULT_VARIANT_TIME;
+}
+
+/** Estimates the number of variants of a test from the providers planned for its argument types */
+static double estimateVariants(const struct Signature *sig)
+{
+	pthread_mutex_lock(&providerLock);
+	size_t variants = countVariants(sig, false);
+	pthread_mutex_unlock(&providerLock);
+	return variants;
+}
+
+double historyEstimate(const struct DL *dl)
+{
+	double perVariant = variantTime(), total = 0;
+	bool known = false;
+
+	for(size_t i = 1; (dl->handle || dl->lazy) && i < dl->symbolCount; ++i)
+	{
+		const char *name = dl->strings + dl->symbols[i].st_name;
+		struct Signature sig;
+
+		if(strncmp(name, "_SIG_TEST_", 10) != 0 || !parseSignature(dl->elfOffset + dl->symbols[i].st_value, &sig))
+			continue;
+
+		const struct Timing *t = findTiming(dl->name, name + 10);
+		total += t ? t->seconds : perVariant * estimateVariants(&sig);
+		known |= t != NULL;
+	}
+
+	// none of its tests have a history, e.g. since they were renamed, but the object's total is the better guess then
+	const struct Timing *m = known ? NULL : findTiming(dl->name, NULL);
+
+	return m ? m->seconds : total;
+}
+
+void historyRecordTest(const struct DL *dl, const char *testName, size_t variants, double seconds)
+{
+	pthread_mutex_lock(&timingsLock);
+	record(dl->name, testName, variants, seconds);
+	pthread_mutex_unlock(&timingsLock);
+}
+
+void historyRecordModule(const struct DL *dl)
+{
+	pthread_mutex_lock(&timingsLock);
+	record(dl->name, NULL, dl->variants, dl->duration);
+	pthread_mutex_unlock(&timingsLock);
+}
+
+void historySave(void)
+{
+	if(options.historyFile == NULL)
+		return;
+
+	// written to a separate file first, so that an interrupted run doesn't lose the history
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", options.historyFile);
+	FILE *f = fopen(tmp, "w");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't write the duration history: fopen(%s): %s\n"), tmp, strerror(errno));
+		return;
+	}
+
+	for(size_t i = 0; i < timingCount; ++i)
+		fprintf(f, "%s\t%s\t%zu\t%.9f\n", timings[i].module, timings[i].test ? timings[i].test : "", timings[i].variants, timings[i].seconds);
+
+	if(fclose(f) || rename(tmp, options.historyFile))
+	{
+		fprintf(stderr, YELLOW("Couldn't write the duration history '%s': %s\n"), options.historyFile, strerror(errno));
+		unlink(tmp);
+	}
+}
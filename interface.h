@@ -2,6 +2,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 /** The type of a provider function */
 typedef size_t (*provider_f)(size_t, void*);
@@ -89,6 +90,52 @@ typedef size_t (*format_f)(char*, size_t, const void*);
 	size_t name(size_t cap, UNCOMMA(UNPAREN(type)) buf[restrict static cap]); \
 	size_t CCAT(format_ , UNSEP(UNPAREN(type)) )(char *to, size_t n, const UNCOMMA(UNPAREN(type)) thing[restrict static 1]);
 
+/** How a DERIVED_PROVIDER() computes its elements from its sources */
+enum Derivation
+{
+	/** Applies `void func(const S *in, T *out)` to every element of the only source */
+	DERIVE_MAP,
+	/** Keeps the elements `x` of the only source, which has the same type, for which `bool func(const T *x)` returns true */
+	DERIVE_FILTER,
+	/** Combines the i-th elements of two sources via `void func(const A *a, const B *b, T *out)`, up to the length of the shorter one */
+	DERIVE_ZIP,
+	/** Provides the elements of every source in order, which all have the same type */
+	DERIVE_CONCAT
+};
+
+/** The description of a provider emitted by DERIVED_PROVIDER() */
+struct DerivedProvider
+{
+	enum Derivation op;
+	/** The names of the source providers, as given to PROVIDER() or DERIVED_PROVIDER(), separated and terminated by NUL */
+	const char *sources;
+	/** The function applied to the elements of the sources, see `enum Derivation` */
+	void (*func)(void);
+};
+
+/** Declares a provider whose data is computed from other providers, without storing a copy of it.
+	Mapped and zipped elements are computed whenever a test needs them, and filters only store the indices of the kept elements.
+	@param type The type that is provided, as with PROVIDER()
+	@param name The human-readable, C-valid identifier for this dataset
+	@param op An `enum Derivation`
+	@param func The function applied to the sources, see `enum Derivation`, or NULL for DERIVE_CONCAT
+	@param ... The names of the source providers, which may be located in any test object
+*/
+#define DERIVED_PROVIDER(type, name, op, func, ...) \
+	const char _PROVIDER_##name[] = STR(UNCOMMA(UNPAREN(type))); \
+	const size_t _SIZEOF_PROVIDER_##name = sizeof(UNCOMMA(UNPAREN(type))); \
+	const struct DerivedProvider _DERIVED_PROVIDER_##name = { op, JOIN(__VA_ARGS__), (void (*)(void))(func) }; \
+	size_t CCAT(format_ , UNSEP(UNPAREN(type)) )(char *to, size_t n, const UNCOMMA(UNPAREN(type)) thing[restrict static 1]);
+
+/** Declares a provider applying `void func(const S *in, T *out)` to every element of `source` */
+#define MAP_PROVIDER(type, name, source, func) DERIVED_PROVIDER(type, name, DERIVE_MAP, func, source)
+/** Declares a provider of the elements `x` of `source` for which `bool pred(const T *x)` returns true */
+#define FILTER_PROVIDER(type, name, source, pred) DERIVED_PROVIDER(type, name, DERIVE_FILTER, pred, source)
+/** Declares a provider combining the i-th elements of `a` and `b` via `void func(const A *a, const B *b, T *out)` */
+#define ZIP_PROVIDER(type, name, a, b, func) DERIVED_PROVIDER(type, name, DERIVE_ZIP, func, a, b)
+/** Declares a provider of the elements of every listed provider in order */
+#define CONCAT_PROVIDER(type, name, ...) DERIVED_PROVIDER(type, name, DERIVE_CONCAT, NULL, __VA_ARGS__)
+
 /** Declare a testing function. Followed by a function body using the listed arguments and returning a bool.
 	@param func A human-readable, C-valid identifier for this test
 	@param ... A list of every function argument, with `,` between type and name.
@@ -100,6 +147,78 @@ typedef size_t (*format_f)(char*, size_t, const void*);
 	{ func INVOKE_PTR_ARGS(__VA_ARGS__); } \
 	void func PAIR(__VA_ARGS__)
 
+/** Declares a testing function like TEST(), whose variants may wait for I/O via `asyncRead()` and `asyncWrite()`.
+	ccheck runs many variants of it concurrently on a single thread, each on its own stack,
+	switching to another variant whenever one waits for I/O or calls `asyncYield()`.
+	@warning Variants may interleave, so they must not share mutable state such as file offsets. Use separate files or distinct offsets.
+ */
+#define ASYNC_TEST(func, ...) \
+	const char _ASYNC_TEST_##func = 1; \
+	TEST(func, __VA_ARGS__)
+
+/** Declares a testing function like TEST(), which may run on several threads at once.
+	Under `--stress`, ccheck runs its variants concurrently on increasing numbers of threads and reports how its throughput scales.
+	@warning Only state of the subjects may be shared between variants, and it must be synchronized by the subjects themselves.
+ */
+#define THREADSAFE_TEST(func, ...) \
+	const char _THREADSAFE_TEST_##func = 1; \
+	TEST(func, __VA_ARGS__)
+
+/** Declares the state that the variants of TEST_WITH() tests share as `struct name`, followed by its members in braces and a semicolon.
+	Every fixture needs a FIXTURE_SETUP(), and may have a FIXTURE_TEARDOWN() and a FIXTURE_RESET().
+	ccheck sets a fixture up once per thread and test object, when the first of the object's tests uses it, and tears it down after the object's last test.
+	A fixture is set up again after a variant using it failed, since that may have left it in any state.
+ */
+#define FIXTURE(name) struct name
+
+/** Defines the setup of a fixture. Followed by a function body initializing `struct name *fixture`, which starts out zeroed.
+	It may fail like a test, which fails the test that needed the fixture.
+ */
+#define FIXTURE_SETUP(name) \
+	const size_t _SIZEOF_FIXTURE_##name = sizeof(struct name); \
+	void _FIXTURE_SETUP_##name(struct name *fixture)
+
+/** Defines the teardown of a fixture. Followed by a function body releasing the resources of `struct name *fixture`. */
+#define FIXTURE_TEARDOWN(name) \
+	void _FIXTURE_TEARDOWN_##name(struct name *fixture)
+
+/** Defines the reset of a fixture, which runs before every variant but the first one after the setup.
+	Followed by a function body undoing changes a passing variant made to `struct name *fixture`.
+ */
+#define FIXTURE_RESET(name) \
+	void _FIXTURE_RESET_##name(struct name *fixture)
+
+/** Declares a testing function like TEST(), that has access to the fixture `struct fix *fixture` declared via FIXTURE() in the same object.
+	@param fix The name given to FIXTURE()
+	@param func A human-readable, C-valid identifier for this test
+	@param ... A list of every function argument, with `,` between type and name.
+ */
+#define TEST_WITH(fix, func, ...) \
+	const char _FIXTURE_TEST_##func[] = #fix; \
+	const char _SIG_TEST_##func[] = JOIN(__VA_ARGS__); \
+	static inline void func PAIR(struct fix *, fixture ,##__VA_ARGS__); \
+	void _TEST_##func PTR_ARGS(__VA_ARGS__) \
+	{ struct fix *_fixture = testFixture(); func INVOKE_PTR_ARGS(struct fix *, &_fixture ,##__VA_ARGS__); } \
+	void func PAIR(struct fix *, fixture ,##__VA_ARGS__)
+
+/** @returns The fixture of the running TEST_WITH() test, as passed to it */
+extern void *testFixture(void);
+
+/** Reads from a file at the given offset like `pread()`, letting other variants of an ASYNC_TEST() run in the meantime.
+	Outside of ASYNC_TEST() it simply blocks.
+	@returns The number of bytes read, or a negative errno value
+ */
+extern ssize_t asyncRead(int fd, void *buf, size_t n, off_t offset);
+
+/** Writes to a file at the given offset like `pwrite()`, letting other variants of an ASYNC_TEST() run in the meantime.
+	Outside of ASYNC_TEST() it simply blocks.
+	@returns The number of bytes written, or a negative errno value
+ */
+extern ssize_t asyncWrite(int fd, const void *buf, size_t n, off_t offset);
+
+/** Lets other variants of an ASYNC_TEST() run before continuing. Does nothing outside of ASYNC_TEST(). */
+extern void asyncYield(void);
+
 /**
 	Aborts the current test run with the given error message.
 	@returns Doesn't return.
@@ -127,3 +246,16 @@ extern void expectExit(unsigned count, const int codes[static count]);
 
 /** Undoes a previous `acceptExit()`. */
 extern void undoExpectExit();
+
+/** An input file from a corpus given to ccheck via `--corpus`, provided to every test taking a `CorpusEntry` argument.
+	The data is mapped read-only and shared between all tests, so it must not be modified.
+ */
+typedef struct CorpusEntry
+{
+	/** The contents of the file, not NUL-terminated */
+	const void *ptr;
+	/** The length of `ptr` in bytes */
+	size_t len;
+	/** The name of the file, relative to the corpus */
+	const char *name;
+} CorpusEntry;
@@ -0,0 +1,156 @@
+/* Lazy loading of test objects without providers.
+	Their symbol tables are read from the file instead, so that they only need to be dlopen()ed while their tests run.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The EI_CLASS of objects that can be loaded into this process */
+#define NATIVE_CLASS (__ELF_NATIVE_CLASS == 64 ? ELFCLASS64 : ELFCLASS32)
+
+/** Guards `resident` */
+static pthread_mutex_t residentLock = PTHREAD_MUTEX_INITIALIZER;
+/** Signaled whenever a lazy object is closed */
+static pthread_cond_t residentFreed = PTHREAD_COND_INITIALIZER;
+/** The number of lazy objects currently opened */
+static size_t resident = 0;
+
+/** Points the symbol table fields of a lazy object at its mapped file
+	@returns false if the file isn't a shared object of this architecture, or if its test signatures can't be located
+ */
+static bool readTables(struct DL *dl)
+{
+	const char *file = dl->file;
+	const ElfW(Ehdr) *eh = dl->file;
+
+	if(dl->fileSize < sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != NATIVE_CLASS
+		|| eh->e_type != ET_DYN || eh->e_shentsize != sizeof(ElfW(Shdr)) || eh->e_phentsize != sizeof(ElfW(Phdr))
+		|| eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > dl->fileSize || eh->e_phoff + eh->e_phnum * sizeof(ElfW(Phdr)) > dl->fileSize)
+		return false;
+
+	const ElfW(Shdr) *sh = (const void*)(file + eh->e_shoff);
+	const ElfW(Phdr) *ph = (const void*)(file + eh->e_phoff);
+	dl->symbols = NULL;
+
+	for(size_t i = 0; i < eh->e_shnum; ++i)
+	{
+		if(sh[i].sh_type != SHT_DYNSYM || sh[i].sh_link >= eh->e_shnum)
+			continue;
+
+		const ElfW(Shdr) *str = &sh[sh[i].sh_link];
+
+		if(sh[i].sh_offset + sh[i].sh_size > dl->fileSize || str->sh_offset + str->sh_size > dl->fileSize)
+			return false;
+
+		dl->symbols = (const void*)(file + sh[i].sh_offset);
+		dl->symbolCount = sh[i].sh_size / sizeof(ElfW(Sym));
+		dl->strings = file + str->sh_offset;
+		break;
+	}
+
+	if(dl->symbols == NULL)
+		return false;
+
+	// signatures are read through `elfOffset`, which must map their addresses to file offsets
+	const ElfW(Phdr) *segment = NULL;
+
+	for(size_t i = 1; i < dl->symbolCount; ++i)
+	{
+		const ElfW(Sym) *s = &dl->symbols[i];
+		const char *name = dl->strings + s->st_name;
+
+		if(strncmp(name, "_SIZEOF_PROVIDER_", 17) == 0)
+			return false;
+		if(strncmp(name, "_SIG_TEST_", 10) != 0 || s->st_shndx == SHN_UNDEF)
+			continue;
+
+		const ElfW(Phdr) *p = ph;
+
+		while(p < ph + eh->e_phnum && !(p->p_type == PT_LOAD && s->st_value >= p->p_vaddr && s->st_value + s->st_size <= p->p_vaddr + p->p_filesz))
+			++p;
+
+		if(p == ph + eh->e_phnum || (segment && p->p_offset - p->p_vaddr != segment->p_offset - segment->p_vaddr)
+			|| p->p_offset + p->p_filesz > dl->fileSize)
+			return false;
+
+		segment = p;
+	}
+
+	dl->elfOffset = segment ? file + segment->p_offset - segment->p_vaddr : file;
+	return true;
+}
+
+bool scanModule(const char *path, struct DL *dl)
+{
+	*dl = (struct DL){ .name = path };
+	int fd = strchr(path, '/') ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+	struct stat st;
+
+	// objects on the library search path are left to dlopen()
+	if(fd < 0)
+		return false;
+	if(fstat(fd, &st) || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(map == MAP_FAILED)
+		return false;
+
+	dl->file = map;
+	dl->fileSize = st.st_size;
+	dl->lazy = true;
+
+	if(! readTables(dl))
+	{
+		munmap(map, st.st_size);
+		*dl = (struct DL){ .name = path };
+		return false;
+	}
+
+	return true;
+}
+
+bool openLazy(struct DL *dl)
+{
+	pthread_mutex_lock(&residentLock);
+
+	while(options.maxResident && resident >= options.maxResident)
+		pthread_cond_wait(&residentFreed, &residentLock);
+
+	++resident;
+	pthread_mutex_unlock(&residentLock);
+
+	// keeps the tables read from the file, since they describe the same symbols
+	dl->handle = dlopen(dl->name, RTLD_NOW | RTLD_LOCAL);
+
+	if(dl->handle)
+		return true;
+
+	fprintf(stderr, RED_BOLD("Error loading")" '%s': %s\n", dl->name, dlerror());
+	linkerErrors = true;
+	closeLazy(dl);
+	return false;
+}
+
+void closeLazy(struct DL *dl)
+{
+	if(dl->handle)
+		dlclose(dl->handle);
+
+	dl->handle = NULL;
+	pthread_mutex_lock(&residentLock);
+	--resident;
+	pthread_cond_signal(&residentFreed);
+	pthread_mutex_unlock(&residentLock);
+}
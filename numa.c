@@ -0,0 +1,266 @@
+/* --pin: Pins runner threads to cores, and replicates provider data onto every NUMA node so that each runner reads a local copy.
+	Uses the raw mbind(2) syscall and sysfs, so no libnuma is needed.
+*/
+#include "ccheck.h"
+
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** The highest NUMA node number supported */
+#define MAX_NODES 64
+
+__thread int numaNode = -1;
+size_t numaNodes = 0;
+
+/** The CPUs runners are pinned to, in order of worker index. Alternates between nodes, so that few workers still use every memory controller. */
+static int *cpus = NULL;
+static size_t cpuCount = 0;
+/** [0 ; CPU_SETSIZE) -> the node of that CPU, or -1 */
+static int cpuNode[CPU_SETSIZE];
+/** [0 ; numaNodes) -> whether runners may be pinned to a CPU of that node */
+static bool nodeUsed[MAX_NODES];
+/** The affinity of the process before pinning */
+static cpu_set_t allowed;
+/** Set once replication failed, after printing a warning */
+static bool replicationFailed = false;
+
+/** Parses a sysfs CPU list like "0-3,8-11"
+	@param set Receives every listed CPU
+ */
+static void parseCpuList(const char *list, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+
+	for(const char *cur = list; *cur && *cur != '\n';)
+	{
+		char *end;
+		unsigned long lo = strtoul(cur, &end, 10), hi = lo;
+
+		if(end == cur)
+			return;
+		if(*end == '-')
+			hi = strtoul(end + 1, &end, 10);
+
+		for(unsigned long c = lo; c <= hi && c < CPU_SETSIZE; ++c)
+			CPU_SET(c, set);
+
+		cur = *end == ',' ? end + 1 : end;
+	}
+}
+
+bool numaInit(void)
+{
+	if(sched_getaffinity(0, sizeof(allowed), &allowed))
+	{
+		fprintf(stderr, RED_BOLD("Can't pin threads") ": sched_getaffinity(): %s\n", strerror(errno));
+		return false;
+	}
+
+	for(size_t c = 0; c < CPU_SETSIZE; ++c)
+		cpuNode[c] = -1;
+
+	size_t perNode[MAX_NODES] = {0};
+
+	for(int n = 0; n < MAX_NODES; ++n)
+	{
+		char path[64], list[4096];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+		FILE *f = fopen(path, "r");
+
+		if(f == NULL)
+			continue;
+
+		cpu_set_t set;
+		bool read = fgets(list, sizeof(list), f) != NULL;
+		fclose(f);
+
+		if(! read)
+			continue;
+
+		parseCpuList(list, &set);
+		numaNodes = n + 1;
+
+		for(size_t c = 0; c < CPU_SETSIZE; ++c)
+		{
+			if(CPU_ISSET(c, &set) && CPU_ISSET(c, &allowed))
+			{
+				cpuNode[c] = n;
+				nodeUsed[n] = true;
+				++perNode[n];
+			}
+		}
+	}
+
+	cpuCount = CPU_COUNT(&allowed);
+	cpus = malloc(cpuCount * sizeof(int));
+
+	if(cpus == NULL)
+	{
+		fprintf(stderr, RED_BOLD("Can't pin threads") ": malloc() failed\n");
+		return false;
+	}
+
+	size_t k = 0;
+
+	// round-robin across nodes, taking the next unused CPU of each
+	for(size_t rank = 0; k < cpuCount; ++rank)
+	{
+		size_t before = k;
+
+		for(int n = 0; n < (int)numaNodes; ++n)
+		{
+			size_t seen = 0;
+
+			for(size_t c = 0; c < CPU_SETSIZE && rank < perNode[n]; ++c)
+			{
+				if(cpuNode[c] == n && seen++ == rank)
+				{
+					cpus[k++] = c;
+					break;
+				}
+			}
+		}
+
+		if(k == before)
+			break;
+	}
+
+	// CPUs outside of any node, e.g. without sysfs
+	for(size_t c = 0; c < CPU_SETSIZE && k < cpuCount; ++c)
+	{
+		if(CPU_ISSET(c, &allowed) && cpuNode[c] < 0)
+			cpus[k++] = c;
+	}
+
+	cpuCount = k;
+
+	if(options.verbose)
+		printf("Pinning runners to %zu %s on %zu NUMA %s\n", CONJUGATE(cpuCount, "CPU"), CONJUGATE(numaNodes, "node"));
+
+	return true;
+}
+
+void numaPin(size_t index)
+{
+	if(cpuCount == 0)
+		return;
+
+	int cpu = cpus[index % cpuCount];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int e = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	if(e)
+	{
+		fprintf(stderr, YELLOW("Can't pin runner to CPU %d: pthread_setaffinity_np(): %s\n"), cpu, strerror(e));
+		return;
+	}
+
+	// replicas only pay off with more than one node
+	numaNode = numaNodes > 1 ? cpuNode[cpu] : -1;
+}
+
+void numaUnpin(void)
+{
+	if(cpuCount)
+		pthread_setaffinity_np(pthread_self(), sizeof(allowed), &allowed);
+
+	numaNode = -1;
+}
+
+/** Copies data into memory bound to a single node
+	@returns The copy, or NULL on failure
+ */
+static void *replicate(const void *data, size_t len, int node)
+{
+	void *copy = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	unsigned long mask[MAX_NODES / (8 * sizeof(long))] = {0};
+	mask[node / (8 * sizeof(long))] = 1ul << (node % (8 * sizeof(long)));
+
+	if(copy == MAP_FAILED)
+		return NULL;
+
+	// binding before the first touch places every page on the node, no matter which thread copies
+	if(syscall(SYS_mbind, copy, len, MPOL_BIND, mask, MAX_NODES + 1, 0))
+	{
+		int e = errno;
+		munmap(copy, len);
+		errno = e;
+		return NULL;
+	}
+
+	memcpy(copy, data, len);
+	mprotect(copy, len, PROT_READ);
+	return copy;
+}
+
+void numaReplicate(struct ProviderBucket *b)
+{
+	if(numaNodes < 2 || replicationFailed || !options.pin)
+		return;
+
+	for(size_t i = 0; i < b->count; ++i)
+	{
+		struct Provider *p = &b->providers[i];
+		size_t len = p->count * b->elementSize;
+
+		// derived providers read from their sources, which are replicated themselves
+		if(p->replicas || p->derived || len == 0)
+			continue;
+
+		const void **replicas = calloc(numaNodes, sizeof(void*));
+
+		for(size_t n = 0; replicas && n < numaNodes; ++n)
+		{
+			// no runner reads from nodes without usable CPUs
+			if(! nodeUsed[n])
+			{
+				replicas[n] = p->data;
+				continue;
+			}
+
+			replicas[n] = replicate(p->data, len, n);
+
+			if(replicas[n] == NULL)
+			{
+				fprintf(stderr, YELLOW("Provider data will not be replicated across NUMA nodes due to mbind() error: %s\n"), strerror(errno));
+				replicationFailed = true;
+				p->replicas = replicas;
+				numaRelease(p, b->elementSize);
+				return;
+			}
+		}
+
+		p->replicas = replicas;
+	}
+}
+
+void numaRelease(struct Provider *p, size_t elementSize)
+{
+	if(p->replicas == NULL)
+		return;
+
+	for(size_t n = 0; n < numaNodes; ++n)
+	{
+		if(p->replicas[n] && p->replicas[n] != p->data)
+			munmap((void*)p->replicas[n], p->count * elementSize);
+	}
+
+	free(p->replicas);
+	p->replicas = NULL;
+}
+
+void numaCleanup(void)
+{
+	free(cpus);
+	cpus = NULL;
+	cpuCount = 0;
+}
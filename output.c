@@ -0,0 +1,288 @@
+/* --capture-output: Interposes the stdio functions that write to stdout and stderr,
+	so that output of a variant goes to a buffer that is only printed if it fails.
+	Output written to the file descriptors directly, e.g. via write(), isn't captured.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// tests built with _FORTIFY_SOURCE call these instead of their plain counterparts
+int __printf_chk(int flag, const char *fmt, ...);
+int __fprintf_chk(FILE *f, int flag, const char *fmt, ...);
+int __vprintf_chk(int flag, const char *fmt, va_list ls);
+int __vfprintf_chk(FILE *f, int flag, const char *fmt, va_list ls);
+
+/** The number of bytes of output kept per variant, so that chatty tests don't exhaust memory */
+#define CAPTURE_LIMIT (64 << 10)
+
+/** Resolves the libc definition of an interposed function once */
+#define REAL(name) ((__typeof__(&name))real(&real_##name, #name))
+
+static void *real_vfprintf, *real___vfprintf_chk, *real_fputs, *real_puts, *real_fputc, *real_putc, *real_putchar, *real_fwrite;
+
+/** The buffer of every variant run on the calling thread, except for those of ASYNC_TEST()s */
+static __thread struct Capture threadCapture;
+
+/** @returns The function `name` from the objects after ccheck, caching it in `slot` */
+static void *real(void **slot, const char *name)
+{
+	void *f = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+	if(f == NULL)
+	{
+		f = dlsym(RTLD_NEXT, name);
+		__atomic_store_n(slot, f, __ATOMIC_RELAXED);
+	}
+
+	return f;
+}
+
+/** Resolves every interposed function before main(), since dlsym() discards the message that dlerror() returned before,
+	which would break printing that message, as ccheck does whenever an object fails to load
+ */
+__attribute__((constructor))
+static void resolveAll(void)
+{
+	(void)REAL(vfprintf);
+	(void)REAL(__vfprintf_chk);
+	(void)REAL(fputs);
+	(void)REAL(puts);
+	(void)REAL(fputc);
+	(void)REAL(putc);
+	(void)REAL(putchar);
+	(void)REAL(fwrite);
+}
+
+/** @returns Whether a write to `f` goes to the buffer of the running variant */
+static inline bool captured(FILE *f)
+{
+	return runningTest.capturing && (f == stdout || f == stderr);
+}
+
+/** Appends to the buffer of the running variant, up to CAPTURE_LIMIT bytes */
+static void append(const char *data, size_t n)
+{
+	struct Capture *c = runningTest.capture;
+	size_t keep = c->length + n <= CAPTURE_LIMIT ? n : CAPTURE_LIMIT - c->length;
+
+	if(c->length + keep > c->cap)
+	{
+		size_t cap = c->cap ? c->cap : 256;
+
+		while(cap < c->length + keep)
+			cap *= 2;
+
+		char *d = realloc(c->data, cap);
+
+		if(d == NULL)
+			keep = 0;
+		else
+		{
+			c->data = d;
+			c->cap = cap;
+		}
+	}
+
+	if(keep)
+		memcpy(c->data + c->length, data, keep);
+
+	c->length += keep;
+	c->dropped += n - keep;
+}
+
+/** Formats into the buffer of the running variant
+	@returns The number of characters written, as printf()
+ */
+static int appendFormat(const char *fmt, va_list ls)
+{
+	char small[256];
+	va_list copy;
+	va_copy(copy, ls);
+	int n = vsnprintf(small, sizeof(small), fmt, copy);
+	va_end(copy);
+
+	if(n < 0)
+		return n;
+	if((size_t)n < sizeof(small))
+	{
+		append(small, n);
+		return n;
+	}
+
+	char *big = malloc(n + 1);
+
+	if(big == NULL)
+	{
+		runningTest.capture->dropped += n;
+		return n;
+	}
+
+	vsnprintf(big, n + 1, fmt, ls);
+	append(big, n);
+	free(big);
+	return n;
+}
+
+void captureBegin(void)
+{
+	if(! options.captureOutput)
+		return;
+	if(runningTest.capture == NULL)
+		runningTest.capture = &threadCapture;
+
+	runningTest.capture->length = runningTest.capture->dropped = 0;
+	runningTest.capturing = true;
+}
+
+void captureEnd(void)
+{
+	runningTest.capturing = false;
+}
+
+void capturePrint(void)
+{
+	const struct Capture *c = runningTest.capture;
+
+	if(c == NULL || c->length + c->dropped == 0)
+		return;
+
+	fputs("Output:\n", stdout);
+	fwrite(c->data, 1, c->length, stdout);
+
+	if(c->length && c->data[c->length - 1] != '\n')
+		fputc('\n', stdout);
+	if(c->dropped)
+		printf("(%zu more %s dropped)\n", CONJUGATE(c->dropped, "byte"));
+}
+
+void captureFree(struct Capture *c)
+{
+	free(c->data);
+	*c = (struct Capture){0};
+}
+
+void captureThreadClose(void)
+{
+	captureFree(&threadCapture);
+	runningTest.capture = NULL;
+}
+
+
+int vfprintf(FILE *f, const char *fmt, va_list ls)
+{
+	return captured(f) ? appendFormat(fmt, ls) : REAL(vfprintf)(f, fmt, ls);
+}
+
+int vprintf(const char *fmt, va_list ls)
+{
+	return vfprintf(stdout, fmt, ls);
+}
+
+int fprintf(FILE *f, const char *fmt, ...)
+{
+	va_list ls;
+	va_start(ls, fmt);
+	int n = vfprintf(f, fmt, ls);
+	va_end(ls);
+	return n;
+}
+
+int printf(const char *fmt, ...)
+{
+	va_list ls;
+	va_start(ls, fmt);
+	int n = vfprintf(stdout, fmt, ls);
+	va_end(ls);
+	return n;
+}
+
+int __vfprintf_chk(FILE *f, int flag, const char *fmt, va_list ls)
+{
+	return captured(f) ? appendFormat(fmt, ls) : REAL(__vfprintf_chk)(f, flag, fmt, ls);
+}
+
+int __vprintf_chk(int flag, const char *fmt, va_list ls)
+{
+	return __vfprintf_chk(stdout, flag, fmt, ls);
+}
+
+int __fprintf_chk(FILE *f, int flag, const char *fmt, ...)
+{
+	va_list ls;
+	va_start(ls, fmt);
+	int n = __vfprintf_chk(f, flag, fmt, ls);
+	va_end(ls);
+	return n;
+}
+
+int __printf_chk(int flag, const char *fmt, ...)
+{
+	va_list ls;
+	va_start(ls, fmt);
+	int n = __vfprintf_chk(stdout, flag, fmt, ls);
+	va_end(ls);
+	return n;
+}
+
+int fputs(const char *s, FILE *f)
+{
+	if(! captured(f))
+		return REAL(fputs)(s, f);
+
+	append(s, strlen(s));
+	return 0;
+}
+
+int puts(const char *s)
+{
+	if(! captured(stdout))
+		return REAL(puts)(s);
+
+	append(s, strlen(s));
+	append("\n", 1);
+	return 0;
+}
+
+int fputc(int c, FILE *f)
+{
+	if(! captured(f))
+		return REAL(fputc)(c, f);
+
+	char ch = c;
+	append(&ch, 1);
+	return (unsigned char)c;
+}
+
+#undef putc
+int putc(int c, FILE *f)
+{
+	if(! captured(f))
+		return REAL(putc)(c, f);
+
+	char ch = c;
+	append(&ch, 1);
+	return (unsigned char)c;
+}
+
+#undef putchar
+int putchar(int c)
+{
+	if(! captured(stdout))
+		return REAL(putchar)(c);
+
+	char ch = c;
+	append(&ch, 1);
+	return (unsigned char)c;
+}
+
+size_t fwrite(const void *data, size_t size, size_t n, FILE *f)
+{
+	if(! captured(f))
+		return REAL(fwrite)(data, size, n, f);
+
+	append(data, size * n);
+	return n;
+}
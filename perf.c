@@ -0,0 +1,217 @@
+/* Hardware performance counters around test function calls, via perf_event_open(2) */
+#include "ccheck.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** Every counter that may be named in `--perf-counters` */
+static const struct
+{
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} knownCounters[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "stalled-cycles-frontend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND },
+	{ "stalled-cycles-backend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND },
+	{ "ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+#define KNOWN_COUNTERS (sizeof(knownCounters) / sizeof(*knownCounters))
+
+/** Number of requested counters */
+static unsigned counterCount = 0;
+/** [0 ; counterCount) -> index into knownCounters */
+static unsigned counters[MAX_PERF_COUNTERS];
+/** Set once any thread printed a warning about unavailable counters */
+static bool warned = false;
+
+__thread bool perfActive = false;
+/** The group leader of the calling thread, or -1 */
+static __thread int groupFd = -1;
+/** [0 ; counterCount) -> file descriptor of that counter in the group, or -1 if unsupported */
+static __thread int counterFds[MAX_PERF_COUNTERS];
+
+bool perfParse(const char *spec)
+{
+	for(const char *cur = spec; *cur;)
+	{
+		size_t len = strcspn(cur, ",");
+		unsigned k = 0;
+
+		while(k < KNOWN_COUNTERS && (strlen(knownCounters[k].name) != len || strncmp(knownCounters[k].name, cur, len) != 0))
+			++k;
+
+		if(k == KNOWN_COUNTERS)
+		{
+			fprintf(stderr, RED_BOLD("Unknown hardware counter") " '%.*s'. Known counters are:", (int)len, cur);
+
+			for(unsigned i = 0; i < KNOWN_COUNTERS; ++i)
+				fprintf(stderr, "%s %s", i ? "," : "", knownCounters[i].name);
+
+			fputc('\n', stderr);
+			return false;
+		}
+		if(counterCount >= MAX_PERF_COUNTERS)
+		{
+			fprintf(stderr, RED_BOLD("Too many hardware counters") ": At most %u can be measured at once.\n", MAX_PERF_COUNTERS);
+			return false;
+		}
+
+		counters[counterCount++] = k;
+		cur += len;
+
+		if(*cur == ',')
+			++cur;
+	}
+
+	return true;
+}
+
+/** Prints a warning about unavailable counters, but only for the first call in the process */
+static void warnOnce(const char *counter, int err)
+{
+	if(__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED))
+		return;
+
+	fprintf(stderr, YELLOW("Hardware counter '%s' is unavailable: perf_event_open(): %s%s\n"), counter, strerror(err),
+		(err == EACCES || err == EPERM) ? " (check /proc/sys/kernel/perf_event_paranoid)" : "");
+}
+
+void perfThreadInit(void)
+{
+	if(counterCount == 0 || groupFd >= 0)
+		return;
+
+	for(unsigned i = 0; i < counterCount; ++i)
+	{
+		struct perf_event_attr attr = {
+			.size = sizeof(attr),
+			.type = knownCounters[counters[i]].type,
+			.config = knownCounters[counters[i]].config,
+			.disabled = groupFd < 0,
+			.exclude_kernel = 1,
+			.exclude_hv = 1,
+			.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+		};
+
+		int fd = syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
+		counterFds[i] = fd;
+
+		if(fd < 0)
+			warnOnce(knownCounters[counters[i]].name, errno);
+		else if(groupFd < 0)
+			groupFd = fd;
+	}
+
+	perfActive = groupFd >= 0;
+}
+
+void perfThreadClose(void)
+{
+	for(unsigned i = 0; groupFd >= 0 && i < counterCount; ++i)
+	{
+		if(counterFds[i] >= 0)
+			close(counterFds[i]);
+	}
+
+	groupFd = -1;
+	perfActive = false;
+}
+
+void perfReset(void)
+{
+	if(perfActive)
+		ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+}
+
+void perfStart(void)
+{
+	ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void perfStop(void)
+{
+	ioctl(groupFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/** Reads the counter group of the calling thread
+	@param values [0 ; counterCount) -> counter value, scaled up if the kernel had to multiplex counters.
+		Unsupported counters are left untouched.
+	@returns false if the group couldn't be read
+ */
+static bool readCounters(double values[static MAX_PERF_COUNTERS])
+{
+	struct
+	{
+		uint64_t nr;
+		uint64_t timeEnabled;
+		uint64_t timeRunning;
+		struct { uint64_t value, id; } values[MAX_PERF_COUNTERS];
+	} buf;
+
+	if(read(groupFd, &buf, sizeof(buf)) <= 0)
+		return false;
+
+	double scale = (buf.timeRunning && buf.timeRunning < buf.timeEnabled) ? (double)buf.timeEnabled / buf.timeRunning : 1.0;
+
+	// group members are reported in the order they were opened, so skip unsupported counters
+	for(unsigned i = 0, j = 0; i < counterCount && j < buf.nr; ++i)
+	{
+		if(counterFds[i] >= 0)
+			values[i] = buf.values[j++].value * scale;
+	}
+
+	return true;
+}
+
+void perfReport(const struct DL *dl, const char *testName, size_t variants)
+{
+	if(!perfActive || variants == 0)
+		return;
+
+	double values[MAX_PERF_COUNTERS];
+
+	if(! readCounters(values))
+		return;
+
+	char buffer[1024];
+	size_t w = snprintf(buffer, sizeof(buffer), "Counters for %s::%s, per variant:", dl->name, testName);
+	double cycles = -1, instructions = -1;
+
+	for(unsigned i = 0; i < counterCount && w < sizeof(buffer); ++i)
+	{
+		const char *name = knownCounters[counters[i]].name;
+
+		if(counterFds[i] < 0)
+		{
+			w += snprintf(buffer + w, sizeof(buffer) - w, "%s %s n/a", i ? "," : "", name);
+			continue;
+		}
+
+		double avg = values[i] / variants;
+		w += snprintf(buffer + w, sizeof(buffer) - w, "%s %.2f %s", i ? "," : "", avg, name);
+
+		if(knownCounters[counters[i]].config == PERF_COUNT_HW_CPU_CYCLES && knownCounters[counters[i]].type == PERF_TYPE_HARDWARE)
+			cycles = avg;
+		else if(knownCounters[counters[i]].config == PERF_COUNT_HW_INSTRUCTIONS && knownCounters[counters[i]].type == PERF_TYPE_HARDWARE)
+			instructions = avg;
+	}
+
+	if(cycles > 0 && instructions >= 0 && w < sizeof(buffer))
+		snprintf(buffer + w, sizeof(buffer) - w, ", IPC %.2f", instructions / cycles);
+
+	puts(buffer);
+}
@@ -0,0 +1,487 @@
+/* --profile: A sampling profiler attributing the CPU time of runners to the test they run.
+	Each runner arms a SIGPROF timer on its own CPU time, whose handler records the program counter and a short frame-pointer stack into a per-thread ring.
+	The ring is drained and symbolized when the test ends, while every object it may point into is still loaded.
+*/
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/** The sampling interval of CPU time, in nanoseconds */
+#define INTERVAL_NS 1000000
+/** The maximum number of frames recorded per sample */
+#define MAX_DEPTH 16
+/** The number of samples per ring, which must be a power of two. Covers 8 seconds of CPU time per test at the default interval. */
+#define RING_SIZE 8192
+/** The number of hash buckets for collapsed stacks */
+#define STACK_BUCKETS 4096
+/** The number of functions listed per test */
+#define TOP_N 10
+
+/** A test that was profiled */
+struct ProfiledTest
+{
+	/** "module::test", malloc()ed */
+	char *name;
+	/** The number of samples taken while it ran */
+	size_t samples;
+	struct ProfiledTest *next;
+};
+
+/** A sampled call stack */
+struct Sample
+{
+	/** The test running when the sample was taken */
+	struct ProfiledTest *test;
+	unsigned depth;
+	/** [0 ; depth) -> program counters, starting with the innermost frame */
+	uintptr_t pcs[MAX_DEPTH];
+};
+
+/** The samples of one runner. Written by the SIGPROF handler and read by the runner, which the handler interrupts. */
+struct Ring
+{
+	struct Sample samples[RING_SIZE];
+	/** The number of samples ever written and read */
+	size_t head, tail;
+	/** The number of samples dropped because the ring was full */
+	size_t dropped;
+	/** The test currently running, or NULL */
+	struct ProfiledTest *test;
+	/** The bounds of the runner's stack, outside of which frame pointers aren't followed */
+	uintptr_t stackLow, stackHigh;
+	/** The runner's CPU time timer */
+	timer_t timer;
+};
+
+/** The number of times a collapsed stack was sampled during a test */
+struct StackCount
+{
+	const struct ProfiledTest *test;
+	/** Frames separated by ';', outermost first, malloc()ed */
+	char *stack;
+	size_t count;
+	struct StackCount *next;
+};
+
+static __thread struct Ring *ring = NULL;
+
+/** Guards every variable below */
+static pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+/** Every profiled test, most recent first */
+static struct ProfiledTest *tests = NULL;
+static struct StackCount *stacks[STACK_BUCKETS];
+/** The number of samples dropped by any runner */
+static size_t totalDropped = 0;
+
+/** Records a sample of the interrupted code. Only touches the calling thread's ring, since it runs in signal context. */
+static void onProfile(int sig, siginfo_t *info, void *_uc)
+{
+	(void)sig;
+	(void)info;
+	struct Ring *r = ring;
+
+	if(r == NULL || r->test == NULL)
+		return;
+
+	size_t head = r->head;
+
+	if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= RING_SIZE)
+	{
+		++r->dropped;
+		return;
+	}
+
+	const ucontext_t *uc = _uc;
+	struct Sample *s = &r->samples[head % RING_SIZE];
+	uintptr_t fp;
+
+#if defined(__x86_64__)
+	s->pcs[0] = uc->uc_mcontext.gregs[REG_RIP];
+	fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+	s->pcs[0] = uc->uc_mcontext.pc;
+	fp = uc->uc_mcontext.regs[29];
+#else
+	#warning "--profile only records the innermost frame on this architecture"
+	(void)uc;
+	s->pcs[0] = 0;
+	fp = 0;
+#endif
+
+	s->test = r->test;
+	s->depth = 1;
+
+	// code without frame pointers, and coroutine stacks, end the walk early
+	while(s->depth < MAX_DEPTH && fp % sizeof(uintptr_t) == 0 && fp >= r->stackLow && fp + 2 * sizeof(uintptr_t) <= r->stackHigh)
+	{
+		const uintptr_t *frame = (const uintptr_t*)fp;
+
+		if(frame[1] == 0)
+			break;
+
+		// the return address points after the call, which may be past the end of the calling function
+		s->pcs[s->depth++] = frame[1] - 1;
+
+		if(frame[0] <= fp)
+			break;
+
+		fp = frame[0];
+	}
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool profileStart(void)
+{
+	struct sigaction sa = { .sa_sigaction = onProfile, .sa_flags = SA_SIGINFO | SA_RESTART };
+	sigemptyset(&sa.sa_mask);
+
+	if(sigaction(SIGPROF, &sa, NULL))
+	{
+		fprintf(stderr, RED_BOLD("Can't profile") ": sigaction(): %s\n", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+void profileThreadInit(void)
+{
+	if(! options.profile)
+		return;
+
+	struct Ring *r = calloc(1, sizeof(struct Ring));
+	pthread_attr_t attr;
+	void *stack;
+	size_t stackSize;
+
+	if(r == NULL)
+	{
+		fprintf(stderr, YELLOW("Runner will not be profiled: malloc() failed\n"));
+		return;
+	}
+	if(pthread_getattr_np(pthread_self(), &attr) == 0)
+	{
+		if(pthread_attr_getstack(&attr, &stack, &stackSize) == 0)
+		{
+			r->stackLow = (uintptr_t)stack;
+			r->stackHigh = (uintptr_t)stack + stackSize;
+		}
+
+		pthread_attr_destroy(&attr);
+	}
+
+	struct sigevent sev = { .sigev_notify = SIGEV_THREAD_ID, .sigev_signo = SIGPROF };
+	// older glibc versions lack the sigev_notify_thread_id alias
+	sev._sigev_un._tid = gettid();
+	struct itimerspec interval = { .it_interval.tv_nsec = INTERVAL_NS, .it_value.tv_nsec = INTERVAL_NS };
+
+	if(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &r->timer))
+	{
+		fprintf(stderr, YELLOW("Runner will not be profiled due to timer_create() error: %s\n"), strerror(errno));
+		free(r);
+		return;
+	}
+
+	ring = r;
+	timer_settime(r->timer, 0, &interval, NULL);
+}
+
+void profileThreadClose(void)
+{
+	struct Ring *r = ring;
+
+	if(r == NULL)
+		return;
+
+	timer_delete(r->timer);
+	ring = NULL;
+
+	pthread_mutex_lock(&profileLock);
+	totalDropped += r->dropped;
+	pthread_mutex_unlock(&profileLock);
+	free(r);
+}
+
+void profileTestStart(const struct DL *dl, const struct Test *test)
+{
+	if(ring == NULL)
+		return;
+
+	struct ProfiledTest *t = malloc(sizeof(struct ProfiledTest));
+	size_t len = strlen(dl->name) + strlen(test->name) + 3;
+
+	if(t == NULL || (t->name = malloc(len)) == NULL)
+	{
+		free(t);
+		return;
+	}
+
+	snprintf(t->name, len, "%s::%s", dl->name, test->name);
+	t->samples = 0;
+
+	pthread_mutex_lock(&profileLock);
+	t->next = tests;
+	tests = t;
+	pthread_mutex_unlock(&profileLock);
+
+	__atomic_store_n(&ring->test, t, __ATOMIC_RELAXED);
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+/** An object's symbol table, cached while draining a ring */
+struct SymbolCache
+{
+	const struct link_map *lm;
+	struct DL dl;
+	bool ok;
+};
+
+/** Appends the name of the function containing `pc` to a buffer, or "object+0xoffset" if there is no symbol for it
+	@param cache Lookups of objects seen before
+	@returns The number of characters written, or that would have been written, like snprintf()
+ */
+static size_t symbolize(char *to, size_t n, uintptr_t pc, struct SymbolCache cache[static MAX_DEPTH], size_t *cached)
+{
+	Dl_info info;
+	struct link_map *lm;
+
+	if(dladdr1((void*)pc, &info, (void**)&lm, RTLD_DL_LINKMAP) == 0 || lm == NULL)
+		return snprintf(to, n, "0x%zx", (size_t)pc);
+
+	const char *object = *lm->l_name ? lm->l_name : "ccheck";
+	const char *base = strrchr(object, '/');
+	base = base ? base + 1 : object;
+	size_t c = 0;
+
+	while(c < *cached && cache[c].lm != lm)
+		++c;
+
+	if(c == *cached && c < MAX_DEPTH)
+	{
+		cache[c].lm = lm;
+		// the vDSO's dynamic section isn't relocated like those of loaded objects
+		cache[c].ok = strstr(base, "vdso") == NULL && loadLinkMap(lm, object, &cache[c].dl);
+		++*cached;
+	}
+
+	uintptr_t offset = pc - lm->l_addr;
+
+	for(size_t i = 1; c < *cached && cache[c].ok && i < cache[c].dl.symbolCount; ++i)
+	{
+		const ElfW(Sym) *s = &cache[c].dl.symbols[i];
+
+		if(ELF64_ST_TYPE(s->st_info) == STT_FUNC && s->st_shndx != SHN_UNDEF && offset >= s->st_value && offset < s->st_value + s->st_size)
+			return snprintf(to, n, "%s", cache[c].dl.strings + s->st_name);
+	}
+
+	return snprintf(to, n, "%s+0x%zx", base, (size_t)offset);
+}
+
+/** Adds a collapsed stack to the counts of a test. Called with `profileLock` held. */
+static void countStack(const struct ProfiledTest *test, const char *stack)
+{
+	size_t h = (uintptr_t)test;
+
+	for(const char *c = stack; *c; ++c)
+		h = h * 31 + (unsigned char)*c;
+
+	struct StackCount **link = &stacks[h % STACK_BUCKETS];
+
+	for(; *link; link = &(*link)->next)
+	{
+		if((*link)->test == test && strcmp((*link)->stack, stack) == 0)
+		{
+			++(*link)->count;
+			return;
+		}
+	}
+
+	struct StackCount *sc = malloc(sizeof(struct StackCount));
+
+	if(sc == NULL || (sc->stack = strdup(stack)) == NULL)
+	{
+		free(sc);
+		return;
+	}
+
+	sc->test = test;
+	sc->count = 1;
+	sc->next = NULL;
+	*link = sc;
+}
+
+void profileTestEnd(void)
+{
+	struct Ring *r = ring;
+
+	if(r == NULL || r->test == NULL)
+		return;
+
+	__atomic_store_n(&r->test, NULL, __ATOMIC_RELAXED);
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	struct SymbolCache cache[MAX_DEPTH];
+	size_t cached = 0;
+	char stack[MAX_DEPTH * 128];
+
+	pthread_mutex_lock(&profileLock);
+
+	for(size_t t = r->tail; t != head; ++t)
+	{
+		const struct Sample *s = &r->samples[t % RING_SIZE];
+		size_t w = 0;
+
+		for(unsigned d = s->depth; d-- > 0;)
+		{
+			if(w < sizeof(stack))
+				w += symbolize(stack + w, sizeof(stack) - w, s->pcs[d], cache, &cached);
+			if(d && w < sizeof(stack))
+				stack[w++] = ';';
+		}
+
+		stack[w < sizeof(stack) ? w : sizeof(stack) - 1] = 0;
+		++s->test->samples;
+		countStack(s->test, stack);
+	}
+
+	pthread_mutex_unlock(&profileLock);
+	__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+}
+
+/** A function and its number of samples within one test */
+struct HotFunction
+{
+	const char *name;
+	size_t length;
+	size_t samples;
+};
+
+static int _cmp_hot(const void *_l, const void *_r)
+{
+	const struct HotFunction *l = _l, *r = _r;
+	return (l->samples < r->samples) - (l->samples > r->samples);
+}
+
+/** Prints the functions most samples of a test were taken in. Called with `profileLock` held. */
+static void printHotFunctions(const struct ProfiledTest *test)
+{
+	struct HotFunction *hot = NULL;
+	size_t count = 0, cap = 0;
+
+	for(size_t b = 0; b < STACK_BUCKETS; ++b)
+	{
+		for(const struct StackCount *sc = stacks[b]; sc; sc = sc->next)
+		{
+			if(sc->test != test)
+				continue;
+
+			const char *leaf = strrchr(sc->stack, ';');
+			leaf = leaf ? leaf + 1 : sc->stack;
+			size_t len = strlen(leaf), i = 0;
+
+			while(i < count && (hot[i].length != len || strncmp(hot[i].name, leaf, len) != 0))
+				++i;
+
+			if(i == count)
+			{
+				if(count == cap)
+				{
+					struct HotFunction *n = realloc(hot, (cap = cap ? 2 * cap : 16) * sizeof(struct HotFunction));
+
+					if(n == NULL)
+					{
+						free(hot);
+						return;
+					}
+
+					hot = n;
+				}
+
+				hot[count++] = (struct HotFunction){ .name = leaf, .length = len };
+			}
+
+			hot[i].samples += sc->count;
+		}
+	}
+
+	qsort(hot, count, sizeof(struct HotFunction), _cmp_hot);
+	printf("Profile of %s: %zu %s\n", test->name, CONJUGATE(test->samples, "sample"));
+
+	for(size_t i = 0; i < count && i < TOP_N; ++i)
+		printf("  %5.1f%%  %.*s\n", 100.0 * hot[i].samples / test->samples, (int)hot[i].length, hot[i].name);
+
+	free(hot);
+}
+
+void profileReport(void)
+{
+	if(! options.profile)
+		return;
+
+	pthread_mutex_lock(&profileLock);
+	FILE *f = NULL;
+
+	if(options.flamegraph && (f = fopen(options.flamegraph, "w")) == NULL)
+		fprintf(stderr, RED_BOLD("Can't write collapsed stacks") " to '%s': %s\n", options.flamegraph, strerror(errno));
+
+	for(size_t b = 0; f && b < STACK_BUCKETS; ++b)
+	{
+		for(const struct StackCount *sc = stacks[b]; sc; sc = sc->next)
+			fprintf(f, "%s;%s %zu\n", sc->test->name, sc->stack, sc->count);
+	}
+
+	if(f)
+		fclose(f);
+
+	// in the order the tests started
+	struct ProfiledTest *reversed = NULL;
+
+	while(tests)
+	{
+		struct ProfiledTest *t = tests;
+		tests = t->next;
+		t->next = reversed;
+		reversed = t;
+	}
+
+	for(const struct ProfiledTest *t = reversed; t; t = t->next)
+	{
+		if(t->samples)
+			printHotFunctions(t);
+	}
+
+	if(totalDropped)
+		printf(YELLOW("Dropped %zu %s, since tests ran for longer than the sample buffer holds\n"), CONJUGATE(totalDropped, "sample"));
+
+	for(size_t b = 0; b < STACK_BUCKETS; ++b)
+	{
+		while(stacks[b])
+		{
+			struct StackCount *sc = stacks[b];
+			stacks[b] = sc->next;
+			free(sc->stack);
+			free(sc);
+		}
+	}
+
+	while(reversed)
+	{
+		struct ProfiledTest *t = reversed;
+		reversed = t->next;
+		free(t->name);
+		free(t);
+	}
+
+	totalDropped = 0;
+	pthread_mutex_unlock(&profileLock);
+}
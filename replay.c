@@ -0,0 +1,357 @@
+/* The failure database: Failing variants are persisted between runs, so that they can be re-run first or exclusively (--replay) */
+#include "ccheck.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** A failing variant, as stored in one line of the database.
+	Lines contain tab-separated fields: the module, the test and then the provider object, provider name and data index of each argument.
+ */
+struct Failure
+{
+	/** malloc()ed buffer holding every field, separated by NUL bytes */
+	char *line;
+	/** The path of the test object, as given on the command line */
+	const char *module;
+	const char *test;
+	unsigned int arity;
+	/** [0 ; arity) -> name of the object containing the argument's provider */
+	const char *dlNames[MAX_ARITY];
+	/** [0 ; arity) -> name of the argument's provider */
+	const char *providers[MAX_ARITY];
+	/** [0 ; arity) -> index of the argument within its provider's data */
+	size_t indices[MAX_ARITY];
+	/** Set once the test was run again, after which the entry is only kept if the variant failed again */
+	bool settled;
+};
+
+/** The failures recorded by the previous run */
+static struct Failure *recorded = NULL;
+static size_t recordedCount = 0;
+
+/** Guards `fresh` and `freshCount` */
+static pthread_mutex_t freshLock = PTHREAD_MUTEX_INITIALIZER;
+/** The failures recorded during the current run */
+static struct Failure *fresh = NULL;
+static size_t freshCount = 0;
+
+/** Splits a line of the database into its fields
+	@param line A malloc()ed line without trailing newline, owned by `f` on success
+	@returns false if the line is malformed
+ */
+static bool parseFailure(char *line, struct Failure *f)
+{
+	const char *fields[2 + 3 * MAX_ARITY];
+	size_t n = 0;
+
+	for(char *cur = line;; ++n)
+	{
+		if(n == sizeof(fields) / sizeof(*fields))
+			return false;
+
+		fields[n] = cur;
+		cur = strchr(cur, '\t');
+
+		if(cur == NULL)
+			break;
+
+		*cur++ = 0;
+	}
+
+	if(++n < 2 || (n - 2) % 3)
+		return false;
+
+	*f = (struct Failure){ .line = line, .module = fields[0], .test = fields[1], .arity = (n - 2) / 3 };
+
+	for(unsigned int i = 0; i < f->arity; ++i)
+	{
+		char *end;
+		f->dlNames[i] = fields[2 + 3*i];
+		f->providers[i] = fields[3 + 3*i];
+		f->indices[i] = strtoull(fields[4 + 3*i], &end, 10);
+
+		if(end == fields[4 + 3*i] || *end)
+			return false;
+	}
+
+	return true;
+}
+
+size_t failuresLoad(void)
+{
+	if(options.failureDb == NULL)
+		return 0;
+
+	FILE *f = fopen(options.failureDb, "r");
+
+	if(f == NULL)
+	{
+		if(errno != ENOENT)
+			fprintf(stderr, YELLOW("Couldn't read the failure database: fopen(%s): %s\n"), options.failureDb, strerror(errno));
+
+		return 0;
+	}
+
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+
+	while((len = getline(&line, &cap, f)) > 0)
+	{
+		if(line[len - 1] == '\n')
+			line[--len] = 0;
+		if(len == 0)
+			continue;
+
+		struct Failure *r = realloc(recorded, (recordedCount + 1) * sizeof(struct Failure));
+
+		if(r == NULL)
+			break;
+
+		recorded = r;
+
+		if(parseFailure(line, &recorded[recordedCount]))
+		{
+			++recordedCount;
+			line = NULL;
+			cap = 0;
+		}
+		else
+			fprintf(stderr, YELLOW("Ignoring malformed entry in '%s'\n"), options.failureDb);
+	}
+
+	free(line);
+	fclose(f);
+
+	return recordedCount;
+}
+
+bool failuresRecorded(const struct DL *dl, const char *testName)
+{
+	for(size_t i = 0; i < recordedCount; ++i)
+	{
+		if(strcmp(recorded[i].module, dl->name) == 0 && (testName == NULL || strcmp(recorded[i].test, testName) == 0))
+			return true;
+	}
+
+	return false;
+}
+
+/** Looks up the arguments of a recorded variant in the currently loaded providers
+	@param providers Receives the provider of each argument
+	@param scratch Storage for arguments computed by derived providers, `words` per argument
+	@returns false if the providers changed in a way that the variant no longer exists
+ */
+static bool resolveFailure(const struct Failure *f, const struct Test *test, const struct Provider *providers[static MAX_ARITY], const void *args[static MAX_ARITY],
+	size_t words, scratch_t scratch[static MAX_ARITY][words])
+{
+	if(f->arity != test->sig.arity)
+		return false;
+
+	for(unsigned int i = 0; i < f->arity; ++i)
+	{
+		struct ProviderBucket *b = findProvider(test->sig.argTypes[test->sig.argTypeIndices[i]]);
+		size_t p = 0;
+
+		for(; b && p < b->count; ++p)
+		{
+			if(strcmp(b->providers[p].dlName, f->dlNames[i]) == 0 && strcmp(b->providers[p].name, f->providers[i]) == 0)
+				break;
+		}
+
+		if(b == NULL || p == b->count || f->indices[i] >= b->providers[p].count)
+			return false;
+
+		providers[i] = &b->providers[p];
+		args[i] = locateArg(b, p, f->indices[i], scratch[i]);
+	}
+
+	return true;
+}
+
+bool failuresReplay(struct DL *dl, const struct Test *test)
+{
+	for(size_t r = 0; r < recordedCount; ++r)
+	{
+		struct Failure *f = &recorded[r];
+
+		if(f->settled || strcmp(f->module, dl->name) != 0 || strcmp(f->test, test->name) != 0)
+			continue;
+
+		const struct Provider *providers[MAX_ARITY];
+		const void *args[MAX_ARITY];
+		struct ProviderBucket *buckets[MAX_ARITY];
+		f->settled = true;
+
+		for(unsigned int i = 0; i < test->sig.typeCount; ++i)
+			buckets[i] = findProvider(test->sig.argTypes[i]);
+
+		scratch_t scratch[MAX_ARITY][scratchWords(test->sig.typeCount, buckets)];
+
+		if(! resolveFailure(f, test, providers, args, sizeof(scratch[0]) / sizeof(scratch_t), scratch))
+		{
+			if(options.verbose)
+				printf("Dropping recorded failure of %s::%s, since its providers changed\n", dl->name, test->name);
+
+			continue;
+		}
+
+		bool passed = runVariant(test->func, test->sig.arity, args);
+
+		// a variant that passes now runs again along with the rest of its test, which counts it then
+		if(!passed || options.replay)
+		{
+			++dl->variants;
+			telemetryVariant();
+		}
+
+		if(passed)
+			continue;
+
+		format_f formats[MAX_ARITY];
+		char originBuf[MAX_ARITY][256];
+		const char *origins[MAX_ARITY];
+
+		for(unsigned int i = 0; i < f->arity; ++i)
+		{
+			formats[i] = providers[i]->format;
+			snprintf(originBuf[i], sizeof(originBuf[i]), "%s::%s #%zu, replayed", f->dlNames[i], f->providers[i], f->indices[i]);
+			origins[i] = originBuf[i];
+		}
+
+		printFailure(dl, test, formats, args, origins);
+		failuresRecord(dl, test, providers, f->indices);
+		++dl->failed;
+
+		// the remaining entries of this test stay unsettled, and therefore recorded, since they didn't get a chance to pass
+		return false;
+	}
+
+	return true;
+}
+
+void failuresRecord(const struct DL *dl, const struct Test *test, const struct Provider *const providers[], const size_t indices[])
+{
+	if(options.failureDb == NULL)
+		return;
+
+	char *line = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&line, &len);
+
+	if(f == NULL)
+		return;
+
+	fprintf(f, "%s\t%s", dl->name, test->name);
+
+	for(unsigned int i = 0; i < test->sig.arity; ++i)
+		fprintf(f, "\t%s\t%s\t%zu", providers[i]->dlName, providers[i]->name, indices[i]);
+
+	fclose(f);
+	pthread_mutex_lock(&freshLock);
+	struct Failure *r = realloc(fresh, (freshCount + 1) * sizeof(struct Failure));
+
+	if(r && line)
+	{
+		fresh = r;
+
+		if(parseFailure(line, &fresh[freshCount]))
+		{
+			++freshCount;
+			line = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&freshLock);
+	free(line);
+}
+
+/** Writes a list of failures to the database, replacing its previous contents
+	@returns false and prints an error message on failure
+ */
+static bool writeFailures(size_t count, const struct Failure list[])
+{
+	if(count == 0)
+	{
+		if(unlink(options.failureDb) && errno != ENOENT)
+		{
+			fprintf(stderr, YELLOW("Couldn't clear the failure database: unlink(%s): %s\n"), options.failureDb, strerror(errno));
+			return false;
+		}
+
+		return true;
+	}
+
+	// written to a separate file first, so that an interrupted run doesn't lose the database
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", options.failureDb);
+	FILE *f = fopen(tmp, "w");
+
+	if(f == NULL)
+	{
+		fprintf(stderr, YELLOW("Couldn't write the failure database: fopen(%s): %s\n"), tmp, strerror(errno));
+		return false;
+	}
+
+	for(size_t i = 0; i < count; ++i)
+	{
+		fprintf(f, "%s\t%s", list[i].module, list[i].test);
+
+		for(unsigned int a = 0; a < list[i].arity; ++a)
+			fprintf(f, "\t%s\t%s\t%zu", list[i].dlNames[a], list[i].providers[a], list[i].indices[a]);
+
+		fputc('\n', f);
+	}
+
+	if(fclose(f) || rename(tmp, options.failureDb))
+	{
+		fprintf(stderr, YELLOW("Couldn't write the failure database '%s': %s\n"), options.failureDb, strerror(errno));
+		unlink(tmp);
+		return false;
+	}
+
+	return true;
+}
+
+void failuresSave(void)
+{
+	if(options.failureDb == NULL)
+		return;
+
+	// failures of tests that didn't run this time are carried over
+	size_t kept = 0;
+
+	for(size_t i = 0; i < recordedCount; ++i)
+	{
+		if(recorded[i].settled)
+			free(recorded[i].line);
+		else
+			recorded[kept++] = recorded[i];
+	}
+
+	recordedCount = kept;
+	struct Failure *r = realloc(recorded, (recordedCount + freshCount) * sizeof(struct Failure));
+
+	if(r || recordedCount + freshCount == 0)
+	{
+		recorded = r;
+		memcpy(recorded + recordedCount, fresh, freshCount * sizeof(struct Failure));
+		recordedCount += freshCount;
+	}
+	else
+	{
+		for(size_t i = 0; i < freshCount; ++i)
+			free(fresh[i].line);
+	}
+
+	free(fresh);
+	fresh = NULL;
+	freshCount = 0;
+
+	if(writeFailures(recordedCount, recorded) && recordedCount && options.verbose)
+		printf("Recorded %zu %s in '%s'\n", CONJUGATE(recordedCount, "failure"), options.failureDb);
+}
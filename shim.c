@@ -0,0 +1,67 @@
+/* ccheck-shim.so: The first object in every link-map namespace created by `--compare`.
+	Test objects in those namespaces can't see the symbols exported by the ccheck executable,
+	so this object defines them and forwards every call through `_ccheckHooks`, which ccheck fills after loading it.
+	It is linked without libc, and its only dependency, ccheck-subject.so, is found via $ORIGIN,
+	where ccheck places a symlink to the subject build of the namespace.
+*/
+#include "ccheck.h"
+
+struct ShimHooks _ccheckHooks;
+
+void testFailure(const char *fmt, ...)
+{
+	va_list ls;
+	va_start(ls, fmt);
+	_ccheckHooks.testFailureV(fmt, ls);
+	__builtin_unreachable();
+}
+
+void testSuccess()
+{
+	_ccheckHooks.testSuccess();
+	__builtin_unreachable();
+}
+
+void expectExit(unsigned count, const int codes[static count])
+{
+	_ccheckHooks.expectExit(count, codes);
+}
+
+void undoExpectExit()
+{
+	_ccheckHooks.undoExpectExit();
+}
+
+__attribute__((noreturn))
+void exit(int status)
+{
+	_ccheckHooks.exit(status);
+	__builtin_unreachable();
+}
+
+__attribute__((noreturn))
+void __assert_fail(const char *assertion, const char *file, unsigned int line, const char *func)
+{
+	_ccheckHooks.assertFail(assertion, file, line, func);
+	__builtin_unreachable();
+}
+
+ssize_t asyncRead(int fd, void *buf, size_t n, off_t offset)
+{
+	return _ccheckHooks.asyncRead(fd, buf, n, offset);
+}
+
+ssize_t asyncWrite(int fd, const void *buf, size_t n, off_t offset)
+{
+	return _ccheckHooks.asyncWrite(fd, buf, n, offset);
+}
+
+void asyncYield(void)
+{
+	_ccheckHooks.asyncYield();
+}
+
+void *testFixture(void)
+{
+	return _ccheckHooks.testFixture();
+}
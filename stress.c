@@ -0,0 +1,309 @@
+/* --stress: Runs the variants of THREADSAFE_TEST()s on several threads at once against the shared state of the subjects,
+	and measures how their throughput scales with the number of threads.
+*/
+#include "ccheck.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Seconds each number of threads runs a test for */
+#define STRESS_SECONDS 0.25
+/** Variants a thread runs between checks of the deadline */
+#define CHECK_INTERVAL 16
+
+/** A test that passed its regular run, to be stressed afterwards */
+struct StressTarget
+{
+	struct DL *dl;
+	struct Test test;
+	struct StressTarget *next;
+};
+
+/** Guards `targets` */
+static pthread_mutex_t targetLock = PTHREAD_MUTEX_INITIALIZER;
+/** Every registered target, in reverse order of registration until stressRun() */
+static struct StressTarget *targets = NULL;
+
+/** The state shared by the threads stressing one target at one number of threads */
+struct Round
+{
+	const struct StressTarget *target;
+	/** [0 ; typeCount) -> the bucket of each type */
+	struct ProviderBucket *buckets[MAX_ARITY];
+	/** The number of threads running the test */
+	size_t threads;
+	/** Guards `go` */
+	pthread_mutex_t lock;
+	/** Signalled once `go` is set */
+	pthread_cond_t released;
+	/** Set once every thread was started and `deadline` is set */
+	bool go;
+	/** The CLOCK_MONOTONIC time at which threads stop */
+	double deadline;
+	/** Set by the first thread whose variant failed, which stops the others */
+	bool failed;
+};
+
+/** The work of one stressing thread */
+struct Worker
+{
+	struct Round *round;
+	size_t index;
+	pthread_t thread;
+	/** The number of variants run and the time the last one finished */
+	size_t variants;
+	double finished;
+};
+
+void stressAddTarget(struct DL *dl, const struct Test *test)
+{
+	struct StressTarget *t = malloc(sizeof(struct StressTarget));
+
+	if(t == NULL)
+		return;
+
+	*t = (struct StressTarget){ .dl = dl, .test = *test };
+	pthread_mutex_lock(&targetLock);
+	t->next = targets;
+	targets = t;
+	pthread_mutex_unlock(&targetLock);
+}
+
+/** Reverses `targets`, so that they run in the order they were registered in */
+static void reverseTargets(void)
+{
+	struct StressTarget *prev = NULL;
+
+	for(struct StressTarget *t = targets, *next; t; t = next)
+	{
+		next = t->next;
+		t->next = prev;
+		prev = t;
+	}
+
+	targets = prev;
+}
+
+/** Prints a variant that failed under stress, unless another thread did already */
+static void reportFailure(struct Round *r, const size_t curProviders[], const size_t curDataIndices[], const void *const args[])
+{
+	if(__atomic_exchange_n(&r->failed, true, __ATOMIC_RELAXED))
+		return;
+
+	const struct Test *test = &r->target->test;
+	format_f formats[MAX_ARITY];
+	char originBuf[MAX_ARITY][256];
+	const char *origins[MAX_ARITY];
+
+	for(unsigned int i = 0; i < test->sig.arity; ++i)
+	{
+		const struct Provider *p = &r->buckets[test->sig.argTypeIndices[i]]->providers[curProviders[test->sig.argTypeIndices[i]]];
+		formats[i] = p->format;
+		snprintf(originBuf[i], sizeof(originBuf[i]), "%s::%s #%zu, on %zu %s", p->dlName, p->name, curDataIndices[i], CONJUGATE(r->threads, "thread"));
+		origins[i] = originBuf[i];
+	}
+
+	printFailure(r->target->dl, test, formats, args, origins);
+}
+
+/** Runs every variant of the round's test over and over until the deadline, as a pthread entry point
+	@returns NULL
+ */
+static void *stressWorker(void *_w)
+{
+	struct Worker *w = _w;
+	struct Round *r = w->round;
+	const struct Test *test = &r->target->test;
+	const unsigned int arity = test->sig.arity, typeCount = test->sig.typeCount;
+	const int *argTypeIndices = test->sig.argTypeIndices;
+
+	size_t bucketSizes[MAX_ARITY], curProviders[MAX_ARITY] = {0}, curDataCounts[MAX_ARITY], curDataIndices[MAX_ARITY] = {0};
+	const void *args[MAX_ARITY];
+	scratch_t scratch[arity ? arity : 1][scratchWords(typeCount, r->buckets)];
+
+	for(unsigned int t = 0; t < typeCount; ++t)
+		bucketSizes[t] = r->buckets[t]->count;
+	for(unsigned int i = 0; i < arity; ++i)
+		curDataCounts[i] = r->buckets[argTypeIndices[i]]->providers[0].count;
+
+	if(options.pin)
+		numaPin(w->index);
+
+	// every thread uses its own instance of the fixture, which is set up before timing starts
+	if(! fixtureEnter(r->target->dl, test))
+		__atomic_store_n(&r->failed, true, __ATOMIC_RELAXED);
+
+	pthread_mutex_lock(&r->lock);
+
+	while(! r->go)
+		pthread_cond_wait(&r->released, &r->lock);
+
+	pthread_mutex_unlock(&r->lock);
+
+	while(! __atomic_load_n(&r->failed, __ATOMIC_RELAXED) && now() < r->deadline)
+	{
+		for(size_t n = 0; n < CHECK_INTERVAL; ++n)
+		{
+			for(unsigned int i = 0; i < arity; ++i)
+				args[i] = locateArg(r->buckets[argTypeIndices[i]], curProviders[argTypeIndices[i]], curDataIndices[i], scratch[i]);
+
+			if(! runVariant(test->func, arity, args))
+			{
+				reportFailure(r, curProviders, curDataIndices, args);
+				break;
+			}
+
+			++w->variants;
+
+			// wraps around to the first variant after the last one
+			if(! nextCombination(arity, curDataCounts, curDataIndices))
+			{
+				nextCombination(typeCount, bucketSizes, curProviders);
+
+				for(unsigned int i = 0; i < arity; ++i)
+					curDataCounts[i] = r->buckets[argTypeIndices[i]]->providers[curProviders[argTypeIndices[i]]].count;
+			}
+		}
+	}
+
+	w->finished = now();
+	fixtureRelease(NULL);
+	captureThreadClose();
+
+	if(options.pin)
+		numaUnpin();
+
+	return NULL;
+}
+
+/** Runs a test on a number of threads for STRESS_SECONDS
+	@returns The number of variants per second, or a negative number if a variant failed or no thread could be started
+ */
+static double stressRound(const struct StressTarget *t, size_t threads)
+{
+	struct Round r = { .target = t, .threads = threads, .lock = PTHREAD_MUTEX_INITIALIZER, .released = PTHREAD_COND_INITIALIZER };
+	struct Worker *workers = calloc(threads, sizeof(struct Worker));
+
+	if(workers == NULL)
+	{
+		fprintf(stderr, YELLOW("Failed to stress %s::%s on %zu %s: Out of memory\n"), t->dl->name, t->test.name, CONJUGATE(threads, "thread"));
+		return -1;
+	}
+
+	for(unsigned int i = 0; i < t->test.sig.typeCount; ++i)
+		r.buckets[i] = findProvider(t->test.sig.argTypes[i]);
+
+	size_t started = 0;
+
+	for(; started < threads; ++started)
+	{
+		workers[started] = (struct Worker){ .round = &r, .index = started };
+		int e = pthread_create(&workers[started].thread, NULL, stressWorker, &workers[started]);
+
+		if(e)
+		{
+			fprintf(stderr, YELLOW("Failed to stress %s::%s on %zu %s: pthread_create(): %s\n"), t->dl->name, t->test.name, CONJUGATE(threads, "thread"), strerror(e));
+			__atomic_store_n(&r.failed, true, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	// released at once, so that threads started early don't run alone for a while
+	pthread_mutex_lock(&r.lock);
+	double start = now();
+	r.deadline = start + STRESS_SECONDS;
+	r.go = true;
+	pthread_cond_broadcast(&r.released);
+	pthread_mutex_unlock(&r.lock);
+
+	size_t variants = 0;
+	double end = start;
+
+	for(size_t i = 0; i < started; ++i)
+	{
+		pthread_join(workers[i].thread, NULL);
+		variants += workers[i].variants;
+
+		if(workers[i].finished > end)
+			end = workers[i].finished;
+	}
+
+	free(workers);
+
+	if(r.failed || end <= start)
+		return -1;
+
+	return variants / (end - start);
+}
+
+size_t stressRun(void)
+{
+	size_t failed = 0, limit = options.stressThreads;
+	cpu_set_t allowed;
+	reverseTargets();
+
+	// more threads than CPUs only take turns, which measures the scheduler rather than the subject
+	if(targets && sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && (size_t)CPU_COUNT(&allowed) < limit)
+	{
+		limit = CPU_COUNT(&allowed);
+		fprintf(stderr, YELLOW("%zu %s available, stressing on up to as many threads instead of %zu\n"), CONJUGATE(limit, "CPU"), options.stressThreads);
+	}
+
+	for(struct StressTarget *t = targets, *next; t; t = next)
+	{
+		double base = 0, worst = 100;
+		size_t worstThreads = 0;
+		bool ok = true;
+
+		printf("Scaling of %s::%s:\n", t->dl->name, t->test.name);
+
+		// doubling up to the maximum, which is always measured
+		for(size_t threads = 1; ok; threads = threads * 2 < limit ? threads * 2 : limit)
+		{
+			double rate = stressRound(t, threads);
+
+			if(rate < 0)
+			{
+				ok = false;
+				break;
+			}
+
+			if(threads == 1)
+			{
+				base = rate;
+				printf("  %3zu thread:  %12.0f variants/s\n", threads, rate);
+			}
+			else
+			{
+				double efficiency = base > 0 ? 100 * rate / (threads * base) : 0;
+				bool poor = efficiency < options.stressEfficiency;
+
+				printf("  %3zu threads: %12.0f variants/s, \x1B[%um%3.0f%% efficiency\x1B[0m\n", threads, rate, poor ? 31 : 0, efficiency);
+
+				if(efficiency < worst)
+				{
+					worst = efficiency;
+					worstThreads = threads;
+				}
+			}
+
+			if(threads == limit)
+				break;
+		}
+
+		bool slow = ok && worstThreads && worst < options.stressEfficiency;
+
+		if(slow)
+			printf(RED_BOLD("Poor scaling") " of %s::%s: %.0f%% efficiency on %zu threads is below %.0f%%\n",
+				t->dl->name, t->test.name, worst, worstThreads, options.stressEfficiency);
+
+		failed += !ok || slow;
+		next = t->next;
+		free(t);
+	}
+
+	targets = NULL;
+	return failed;
+}
@@ -0,0 +1,321 @@
+/* --telemetry: Serves live progress counters over a Unix domain socket.
+	Every connection receives a single JSON object, terminated by a newline, and is closed afterwards.
+*/
+#include "ccheck.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+__thread struct TelemetrySlot *telemetrySlot = NULL;
+
+/** The listening socket, or -1 */
+static int serverFd = -1;
+static pthread_t server;
+/** Set to stop the server thread */
+static bool stopping = false;
+
+/** Guards `slots`, `slotCount`, `started`, `ended` and `running` against the server thread */
+static pthread_mutex_t telemetryLock = PTHREAD_MUTEX_INITIALIZER;
+/** One slot per worker of the current run */
+static struct TelemetrySlot *slots = NULL;
+static size_t slotCount = 0;
+/** The start and, once it finished, end time of the current run */
+static double started, ended;
+/** Whether a run is in progress */
+static bool running = false;
+
+/** Counters of the current run, updated atomically */
+static size_t testsDone = 0, testsTotal = 0, failures = 0;
+
+/** Appends a JSON string literal to a buffer
+	@returns The number of characters written, or that would have been written, like snprintf()
+ */
+static size_t jsonString(char *to, size_t n, const char *str)
+{
+	size_t w = 0;
+
+	#define PUT(...) w += snprintf(to + (w < n ? w : n), w < n ? n - w : 0, __VA_ARGS__)
+
+	PUT("\"");
+
+	for(const unsigned char *c = (const void*)str; *c; ++c)
+	{
+		if(*c == '"' || *c == '\\')
+			PUT("\\%c", *c);
+		else if(*c < 0x20)
+			PUT("\\u%04x", *c);
+		else
+			PUT("%c", *c);
+	}
+
+	PUT("\"");
+
+	#undef PUT
+
+	return w;
+}
+
+/** Formats the current state as a JSON object, followed by a newline
+	@returns A malloc()ed string, or NULL
+ */
+static char *report(void)
+{
+	pthread_mutex_lock(&telemetryLock);
+
+	size_t cap = 256 + slotCount * (SLOT_NAME_SIZE * 6 + 64);
+	char *buf = malloc(cap);
+
+	if(buf == NULL)
+	{
+		pthread_mutex_unlock(&telemetryLock);
+		return NULL;
+	}
+
+	size_t done = __atomic_load_n(&testsDone, __ATOMIC_RELAXED), total = __atomic_load_n(&testsTotal, __ATOMIC_RELAXED);
+	size_t variants = 0, w = 0;
+	double elapsed = slotCount ? (running ? now() : ended) - started : 0;
+
+	for(size_t i = 0; i < slotCount; ++i)
+		variants += __atomic_load_n(&slots[i].variants, __ATOMIC_RELAXED);
+
+	#define PUT(...) w += snprintf(buf + (w < cap ? w : cap), w < cap ? cap - w : 0, __VA_ARGS__)
+
+	PUT("{\"running\":%s,\"elapsed\":%.3f,\"testsDone\":%zu,\"testsTotal\":%zu,\"variants\":%zu,\"variantsPerSecond\":%.1f,\"failures\":%zu,",
+		running ? "true" : "false", elapsed, done, total, variants, elapsed > 0 ? variants / elapsed : 0.0,
+		__atomic_load_n(&failures, __ATOMIC_RELAXED));
+
+	// extrapolated from the share of finished tests, which is all that's known for every test
+	if(running && done > 0 && done <= total)
+		PUT("\"eta\":%.3f,", elapsed * (total - done) / done);
+	else
+		PUT("\"eta\":null,");
+
+	PUT("\"threads\":[");
+
+	for(size_t i = 0; i < slotCount; ++i)
+	{
+		char test[SLOT_NAME_SIZE];
+		size_t before, after;
+
+		do
+		{
+			before = __atomic_load_n(&slots[i].seq, __ATOMIC_ACQUIRE);
+			memcpy(test, slots[i].test, sizeof(test));
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			after = __atomic_load_n(&slots[i].seq, __ATOMIC_RELAXED);
+		} while((before & 1) || before != after);
+
+		test[sizeof(test) - 1] = 0;
+		PUT(i ? "," : "");
+
+		if(*test)
+			w += jsonString(buf + (w < cap ? w : cap), w < cap ? cap - w : 0, test);
+		else
+			PUT("null");
+	}
+
+	PUT("]}\n");
+
+	#undef PUT
+
+	pthread_mutex_unlock(&telemetryLock);
+	return buf;
+}
+
+/** Answers connections until `stopping` is set, as a pthread entry point
+	@returns NULL
+ */
+static void *serve(void *_)
+{
+	(void)_;
+
+	while(! __atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	{
+		int fd = accept4(serverFd, NULL, NULL, SOCK_CLOEXEC);
+
+		if(fd < 0)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			break;
+		}
+
+		char *msg = report();
+
+		// the client may be gone already, which must not raise SIGPIPE
+		for(size_t off = 0, len = msg ? strlen(msg) : 0; off < len;)
+		{
+			ssize_t w = send(fd, msg + off, len - off, MSG_NOSIGNAL);
+
+			if(w <= 0)
+				break;
+
+			off += w;
+		}
+
+		free(msg);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+bool telemetryStart(void)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if(strlen(options.telemetry) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, RED_BOLD("Can't serve telemetry") " on '%s': Path too long\n", options.telemetry);
+		return false;
+	}
+
+	strcpy(addr.sun_path, options.telemetry);
+	serverFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	struct stat st;
+
+	// a socket left behind by a previous run would block bind(), but anything else at the path is no leftover of ours
+	if(lstat(options.telemetry, &st) == 0)
+	{
+		if(! S_ISSOCK(st.st_mode))
+		{
+			fprintf(stderr, RED_BOLD("Can't serve telemetry") " on '%s': Not a socket, refusing to replace it\n", options.telemetry);
+
+			if(serverFd >= 0)
+				close(serverFd);
+
+			serverFd = -1;
+			return false;
+		}
+
+		unlink(options.telemetry);
+	}
+
+	if(serverFd < 0 || bind(serverFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(serverFd, 16))
+		goto fail;
+
+	int e = pthread_create(&server, NULL, serve, NULL);
+
+	if(e)
+	{
+		errno = e;
+		unlink(options.telemetry);
+		goto fail;
+	}
+
+	return true;
+
+	fail:
+	fprintf(stderr, RED_BOLD("Can't serve telemetry") " on '%s': %s\n", options.telemetry, strerror(errno));
+
+	if(serverFd >= 0)
+		close(serverFd);
+
+	serverFd = -1;
+	return false;
+}
+
+void telemetryBegin(size_t threads, size_t count, struct DL *const modules[static count])
+{
+	if(serverFd < 0)
+		return;
+
+	size_t total = 0;
+
+	for(size_t m = 0; m < count; ++m)
+	{
+		for(size_t i = 1; i < modules[m]->symbolCount; ++i)
+			total += strncmp(modules[m]->strings + modules[m]->symbols[i].st_name, "_SIG_TEST_", 10) == 0;
+	}
+
+	pthread_mutex_lock(&telemetryLock);
+	free(slots);
+	slots = calloc(threads ? threads : 1, sizeof(struct TelemetrySlot));
+	slotCount = slots ? (threads ? threads : 1) : 0;
+	started = now();
+	running = true;
+	__atomic_store_n(&testsDone, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&testsTotal, total, __ATOMIC_RELAXED);
+	__atomic_store_n(&failures, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&telemetryLock);
+}
+
+void telemetryEnd(void)
+{
+	if(serverFd < 0)
+		return;
+
+	pthread_mutex_lock(&telemetryLock);
+	ended = now();
+	running = false;
+	pthread_mutex_unlock(&telemetryLock);
+}
+
+void telemetryThreadInit(size_t index)
+{
+	telemetrySlot = index < slotCount ? &slots[index] : NULL;
+}
+
+void telemetryThreadClose(void)
+{
+	telemetrySlot = NULL;
+}
+
+/** Replaces the test name of the calling thread's slot */
+static void setTest(const char *module, const char *test)
+{
+	struct TelemetrySlot *s = telemetrySlot;
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if(module)
+		snprintf(s->test, sizeof(s->test), "%s::%s", module, test);
+	else
+		*s->test = 0;
+
+	__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+void telemetryTestStart(const struct DL *dl, const struct Test *test)
+{
+	if(telemetrySlot)
+		setTest(dl->name, test->name);
+}
+
+void telemetryTestEnd(bool succeeded)
+{
+	if(telemetrySlot == NULL)
+		return;
+
+	setTest(NULL, NULL);
+	__atomic_fetch_add(&testsDone, 1, __ATOMIC_RELAXED);
+
+	if(! succeeded)
+		__atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+}
+
+void telemetryStop(void)
+{
+	if(serverFd < 0)
+		return;
+
+	__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+	// wakes the server thread from accept()
+	shutdown(serverFd, SHUT_RDWR);
+	pthread_join(server, NULL);
+	close(serverFd);
+	unlink(options.telemetry);
+	serverFd = -1;
+
+	free(slots);
+	slots = NULL;
+	slotCount = 0;
+}
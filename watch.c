@@ -0,0 +1,285 @@
+/* --watch: Keeps ccheck resident and re-runs the tests of objects whenever they are rebuilt */
+#include "ccheck.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/** Time in milliseconds without further events after which a rebuild is considered complete.
+	Linkers and build systems write objects in several steps.
+ */
+#define SETTLE_MS 50
+
+/** A subject or test object being watched */
+struct WatchedFile
+{
+	/** The inotify watch descriptor of the containing directory */
+	int wd;
+	/** The file name within that directory */
+	char base[NAME_MAX + 1];
+	/** Whether the file changed since it was last loaded */
+	bool changed;
+};
+
+/** Watches the directory containing an object. Directories are watched instead of the objects themselves,
+	since linkers usually replace files instead of writing to them.
+	@param handle The object loaded from `path`, used to locate objects found via the library search path. May be NULL.
+	@returns false and prints an error message on failure
+ */
+static bool addWatch(int fd, const char *path, void *handle, struct WatchedFile *wf)
+{
+	struct link_map *lm;
+	char resolved[PATH_MAX];
+
+	// objects without a '/' were found via the library search path, so ask the loader where
+	if(!strchr(path, '/') && handle && dlinfo(handle, RTLD_DI_LINKMAP, &lm) == 0 && lm->l_name[0])
+		path = lm->l_name;
+	if(realpath(path, resolved))
+		path = resolved;
+
+	const char *slash = strrchr(path, '/');
+	char dir[PATH_MAX] = ".";
+
+	if(slash)
+		snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + (slash == path), path);
+
+	snprintf(wf->base, sizeof(wf->base), "%s", slash ? slash + 1 : path);
+	wf->changed = false;
+	wf->wd = inotify_add_watch(fd, dir, IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO);
+
+	if(wf->wd < 0)
+	{
+		fprintf(stderr, RED_BOLD("Can't watch") " '%s': inotify_add_watch(%s): %s\n", path, dir, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/** Blocks until at least one watched file changed and no events arrived for SETTLE_MS
+	@returns false if reading events failed
+ */
+static bool awaitChanges(int fd, size_t fileCount, struct WatchedFile files[static fileCount])
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool any = false;
+
+	for(int timeout = -1;;)
+	{
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int r = poll(&pfd, 1, timeout);
+
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r < 0)
+		{
+			fprintf(stderr, RED_BOLD("Stopped watching") ": poll(): %s\n", strerror(errno));
+			return false;
+		}
+		if(r == 0)
+			return true;
+
+		ssize_t n = read(fd, buf, sizeof(buf));
+
+		if(n < 0)
+		{
+			fprintf(stderr, RED_BOLD("Stopped watching") ": read(): %s\n", strerror(errno));
+			return false;
+		}
+
+		for(const char *cur = buf; cur < buf + n;)
+		{
+			const struct inotify_event *ev = (const void*)cur;
+			cur += sizeof(struct inotify_event) + ev->len;
+
+			for(size_t i = 0; ev->len && i < fileCount; ++i)
+			{
+				if(files[i].wd == ev->wd && strcmp(files[i].base, ev->name) == 0)
+					any = files[i].changed = true;
+			}
+		}
+
+		// only start the settling timer once a watched file is affected
+		if(any)
+			timeout = SETTLE_MS;
+	}
+}
+
+/** Collects the types of every provider in a test object
+	@param types A malloc()ed list of malloc()ed type names to append to
+	@param n The length of `types`
+ */
+static void providedTypes(const struct DL *dl, char ***types, size_t *n)
+{
+	for(size_t i = 1; dl->handle && i < dl->symbolCount; ++i)
+	{
+		const char *name = dl->strings + dl->symbols[i].st_name;
+		const char *type;
+
+		if(strncmp(name, "_PROVIDER_", 10) != 0 || (type = dlsym(dl->handle, name)) == NULL)
+			continue;
+
+		char **t = realloc(*types, (*n + 1) * sizeof(char*));
+
+		if(t && (t[*n] = strdup(type)))
+			++*n;
+		if(t)
+			*types = t;
+	}
+}
+
+/** Warns if an object stayed loaded after dlclose(), since then its changes can't be picked up */
+static void checkUnloaded(const char *path)
+{
+	void *h = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+
+	if(h)
+	{
+		fprintf(stderr, YELLOW("'%s' could not be unloaded, its changes will not take effect\n"), path);
+		dlclose(h);
+	}
+}
+
+void watch(size_t subjectCount, void *subjects[static subjectCount], const char *const subjectNames[static subjectCount])
+{
+	int fd = inotify_init1(IN_CLOEXEC);
+
+	if(fd < 0)
+	{
+		fprintf(stderr, RED_BOLD("Can't watch for changes") ": inotify_init1(): %s\n", strerror(errno));
+		return;
+	}
+
+	// --affected-by only selects the objects of the first run
+	for(size_t i = 0; i < dlCount; ++i)
+		dls[i].unaffected = false;
+
+	// subjects first, then test objects
+	size_t fileCount = subjectCount + dlCount;
+	struct WatchedFile files[fileCount];
+
+	for(size_t i = 0; i < fileCount; ++i)
+	{
+		bool ok = i < subjectCount
+			? addWatch(fd, subjectNames[i], subjects[i], &files[i])
+			: addWatch(fd, dls[i - subjectCount].name, dls[i - subjectCount].handle, &files[i]);
+
+		if(! ok)
+		{
+			close(fd);
+			return;
+		}
+	}
+
+	for(;;)
+	{
+		printf("Watching %zu %s for changes...\n", CONJUGATE(fileCount, "object"));
+		fflush(stdout);
+
+		if(! awaitChanges(fd, fileCount, files))
+			break;
+
+		double start = now();
+		bool subjectChanged = false;
+		struct DL *rerun[dlCount];
+		size_t rerunCount = 0;
+		linkerErrors = false;
+
+		for(size_t i = 0; i < subjectCount; ++i)
+			subjectChanged |= files[i].changed;
+
+		if(subjectChanged)
+		{
+			// test objects are bound to the subjects' old symbols, so everything has to go
+			puts("Subjects changed, reloading every object");
+
+			for(size_t i = 0; i < dlCount; ++i)
+				closeModule(&dls[i]);
+
+			for(size_t i = 0; i < subjectCount; ++i)
+			{
+				if(subjects[i])
+				{
+					dlclose(subjects[i]);
+					checkUnloaded(subjectNames[i]);
+				}
+			}
+
+			for(size_t i = 0; i < subjectCount; ++i)
+				subjects[i] = openSubject(subjectNames[i]);
+
+			for(size_t i = 0; i < dlCount; ++i)
+			{
+				openModule(dls[i].name, &dls[i]);
+				rerun[rerunCount++] = &dls[i];
+			}
+		}
+		else
+		{
+			// tests in other objects must re-run if a type they use changed its providers
+			char **types = NULL;
+			size_t typeCount = 0;
+
+			for(size_t i = 0; i < dlCount; ++i)
+			{
+				if(! files[subjectCount + i].changed)
+					continue;
+
+				printf("Reloading '%s'\n", dls[i].name);
+				providedTypes(&dls[i], &types, &typeCount);
+				bool wasLoaded = dls[i].handle != NULL;
+				closeModule(&dls[i]);
+
+				if(wasLoaded)
+					checkUnloaded(dls[i].name);
+			}
+
+			for(size_t i = 0; i < dlCount; ++i)
+			{
+				if(! files[subjectCount + i].changed)
+					continue;
+
+				openModule(dls[i].name, &dls[i]);
+				providedTypes(&dls[i], &types, &typeCount);
+				rerun[rerunCount++] = &dls[i];
+			}
+
+			for(size_t i = 0; i < dlCount; ++i)
+			{
+				for(size_t t = 0; !files[subjectCount + i].changed && t < typeCount; ++t)
+				{
+					if(usesType(&dls[i], types[t]))
+					{
+						rerun[rerunCount++] = &dls[i];
+						break;
+					}
+				}
+			}
+
+			for(size_t t = 0; t < typeCount; ++t)
+				free(types[t]);
+
+			free(types);
+		}
+
+		for(size_t i = 0; i < fileCount; ++i)
+			files[i].changed = false;
+
+		// also schedules providers of unchanged objects for types that only the new tests use
+		planProviders();
+		runModules(rerunCount, rerun);
+
+		if(linkerErrors)
+			puts(RED("There were linking errors"));
+
+		printf("Re-ran %zu %s in %.0fms\n", CONJUGATE(rerunCount, "module"), (now() - start) * 1000);
+	}
+
+	close(fd);
+}